@@ -6,308 +6,4785 @@
 #include <map>        // для асоціативних масивів (std::map)
 #include <fstream>    // для роботи з файлами (ifstream, ofstream)
 #include <limits>     // для std::numeric_limits (очищення вводу)
-#include <iomanip>    // для керування виводом чисел (setprecision)
+#include <cstdint>    // для цілих типів фіксованого розміру (uint32_t)
+#include <deque>      // для std::deque (гаманці не переміщуються при додаванні нових)
+#include <string_view> // для std::string_view (ключі без копіювання)
+#include <unordered_map> // для хеш-індексів
+#include <memory>     // для std::shared_ptr (спільне відображення файлу)
+#include <cstring>    // для memcpy
+#include <cstdio>     // для FILE* (журнал операцій)
+#include <chrono>     // для інтервалу групового коміту журналу
+#include <filesystem> // для обрізання пошкодженого хвоста журналу
+#include <mutex>      // для std::mutex (блокування гаманця, журналу)
+#include <shared_mutex> // для std::shared_mutex (багато читачів / один письменник)
+#include <atomic>     // для атомарних лічильників і балансу
+#include <thread>     // для пулу потоків звітів
+#include <condition_variable> // для очікування задач у пулі
+#include <functional> // для std::function (задача пулу)
+#include <exception>  // для передачі винятку з потоку пулу
+#include <charconv>   // для std::from_chars/to_chars (розбір і форматування чисел без iostream)
+#include <cmath>      // для llround (перетворення старих сум з double)
+#include <sstream>    // для std::ostringstream (відбитки стану в самоперевірці)
+
+#if defined(_WIN32)   // відображення файлів у пам'ять
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>       // для _commit (скидання журналу на диск)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <csignal>     // для SIGXFSZ (самоперевірка збою запису журналу)
+#include <sys/resource.h> // для setrlimit (ліміт розміру файлу в самоперевірці)
+#endif
 
 using namespace std;
 
-// Типи гаманців/карт
-enum class WalletType { DEBIT, CREDIT };
+// Вбудовані метрики гарячих шляхів (лічильники, гістограми затримок, байти звітів).
+// Збірка з -DFINANCE_METRICS=0 прибирає їх повністю: макроси нижче стають порожніми.
+#ifndef FINANCE_METRICS
+#define FINANCE_METRICS 1
+#endif
+
+#if FINANCE_METRICS
+// Лічильник, який збільшують з багатьох потоків (relaxed: потрібне лише підсумкове значення)
+struct MetricCounter {
+    atomic<uint64_t> value{ 0 };
+    void add(uint64_t n = 1) { value.fetch_add(n, memory_order_relaxed); }
+    uint64_t get() const { return value.load(memory_order_relaxed); }
+};
+
+// Гістограма затримок: межі кошиків 1.024 мкс * 4^i (до ~4.3 с) і кошик "+Inf"
+struct LatencyHistogram {
+    static constexpr size_t BucketCount = 12;
+    static constexpr uint64_t boundNs(size_t i) { return 1024ull << (2 * i); }
+
+    MetricCounter buckets[BucketCount + 1];
+    MetricCounter sumNs;
+
+    void observe(uint64_t ns) {
+        size_t i = 0;
+        while (i < BucketCount && ns > boundNs(i)) ++i;
+        buckets[i].add();
+        sumNs.add(ns);
+    }
+};
+
+// Усі метрики процесу. Глобальні, бо гаманці оновлюють їх без вказівника на менеджер.
+struct FinanceMetrics {
+    MetricCounter spendOk, spendInsufficientFunds, spendCreditLimit, spendInvalid;
+    MetricCounter deposits;
+    MetricCounter reportBytes, reportFlushes, reportAllocations;
+    LatencyHistogram spend, deposit, topExpenses, topCategories, reportWrite, reportSave, exportRows, importCsv, snapshot;
+};
+
+FinanceMetrics financeMetrics;
+
+// Записує тривалість області видимості у гістограму
+class ScopedLatency {
+private:
+    LatencyHistogram& histogram;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+public:
+    explicit ScopedLatency(LatencyHistogram& h) : histogram(h) {}
+    ~ScopedLatency() {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        histogram.observe(static_cast<uint64_t>(ns));
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+};
+
+// Те саме для дешевих операцій (spend, deposit): два читання годинника коштують порівняно
+// з самою операцією, тому міряється лише кожен SampleEvery-й виклик у потоці
+class SampledLatency {
+private:
+    LatencyHistogram* histogram = nullptr;  // nullptr - цей виклик не міряється
+    chrono::steady_clock::time_point start;
+
+public:
+    static constexpr uint32_t SampleEvery = 16;
+
+    explicit SampledLatency(LatencyHistogram& h) {
+        static thread_local uint32_t calls = 0;
+        if (++calls % SampleEvery == 0) {
+            histogram = &h;
+            start = chrono::steady_clock::now();
+        }
+    }
+    ~SampledLatency() {
+        if (!histogram) return;
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        histogram->observe(static_cast<uint64_t>(ns));
+    }
+    SampledLatency(const SampledLatency&) = delete;
+    SampledLatency& operator=(const SampledLatency&) = delete;
+};
+
+#define FINANCE_METRIC_TIMER(histogram) ScopedLatency financeTimer_##histogram(financeMetrics.histogram)
+#define FINANCE_METRIC_SAMPLED_TIMER(histogram) SampledLatency financeTimer_##histogram(financeMetrics.histogram)
+#define FINANCE_METRIC_ADD(counter, n) financeMetrics.counter.add(n)
+#else
+#define FINANCE_METRIC_TIMER(histogram) ((void)0)
+#define FINANCE_METRIC_SAMPLED_TIMER(histogram) ((void)0)
+#define FINANCE_METRIC_ADD(counter, n) ((void)0)
+#endif
+
+// Метрики у текстовому форматі Prometheus
+void writeMetrics(ostream& out) {
+#if FINANCE_METRICS
+    const FinanceMetrics& m = financeMetrics;
+    char num[64];
+    out << "# HELP finance_spend_total Wallet::spend calls by result.\n"
+        << "# TYPE finance_spend_total counter\n"
+        << "finance_spend_total{result=\"ok\"} " << m.spendOk.get() << "\n"
+        << "finance_spend_total{result=\"insufficient_funds\"} " << m.spendInsufficientFunds.get() << "\n"
+        << "finance_spend_total{result=\"credit_limit\"} " << m.spendCreditLimit.get() << "\n"
+        << "finance_spend_total{result=\"invalid_amount\"} " << m.spendInvalid.get() << "\n"
+        << "# HELP finance_deposit_total Accepted Wallet::deposit calls.\n"
+        << "# TYPE finance_deposit_total counter\n"
+        << "finance_deposit_total " << m.deposits.get() << "\n"
+        << "# HELP finance_report_bytes_total Bytes written through report buffers.\n"
+        << "# TYPE finance_report_bytes_total counter\n"
+        << "finance_report_bytes_total " << m.reportBytes.get() << "\n"
+        << "# HELP finance_report_flushes_total Report buffer writes to a stream.\n"
+        << "# TYPE finance_report_flushes_total counter\n"
+        << "finance_report_flushes_total " << m.reportFlushes.get() << "\n"
+        << "# HELP finance_report_buffer_allocations_total Report buffer growths seen at flush time.\n"
+        << "# TYPE finance_report_buffer_allocations_total counter\n"
+        << "finance_report_buffer_allocations_total " << m.reportAllocations.get() << "\n"
+        << "# HELP finance_operation_duration_seconds Latency of FinanceManager operations (spend and deposit: every 16th call per thread).\n"
+        << "# TYPE finance_operation_duration_seconds histogram\n";
+    const pair<const char*, const LatencyHistogram*> ops[] = {
+        { "spend", &m.spend }, { "deposit", &m.deposit }, { "top_expenses", &m.topExpenses },
+        { "top_categories", &m.topCategories }, { "report_write", &m.reportWrite }, { "report_save", &m.reportSave },
+        { "export", &m.exportRows }, { "import", &m.importCsv }, { "snapshot", &m.snapshot },
+    };
+    for (const auto& op : ops) {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= LatencyHistogram::BucketCount; ++i) {
+            cumulative += op.second->buckets[i].get();
+            if (i < LatencyHistogram::BucketCount) snprintf(num, sizeof(num), "%g", static_cast<double>(LatencyHistogram::boundNs(i)) / 1e9);
+            else snprintf(num, sizeof(num), "+Inf");
+            out << "finance_operation_duration_seconds_bucket{op=\"" << op.first << "\",le=\"" << num << "\"} " << cumulative << "\n";
+        }
+        snprintf(num, sizeof(num), "%.9g", static_cast<double>(op.second->sumNs.get()) / 1e9);
+        out << "finance_operation_duration_seconds_sum{op=\"" << op.first << "\"} " << num << "\n"
+            << "finance_operation_duration_seconds_count{op=\"" << op.first << "\"} " << cumulative << "\n";
+    }
+#else
+    out << "# finance metrics are disabled (built with FINANCE_METRICS=0)\n";
+#endif
+}
+
+// Типи гаманців/карт
+enum class WalletType { DEBIT, CREDIT };
+
+// Ідентифікатори рядків, гаманців і категорій у стовпцях сховища
+using RowId = uint32_t;
+using WalletId = uint32_t;
+using CategoryId = uint32_t;
+
+// Гроші у фіксованій точці: ціле число мінімальних одиниць (копійок/центів).
+// Додавання і порівняння точні, тож баланси не накопичують похибку округлення,
+// а суми не залежать від порядку додавання (однакові за будь-якої кількості потоків).
+class Money {
+private:
+    int64_t minor = 0;
+
+public:
+    static constexpr int64_t Scale = 100; // мінімальних одиниць в одиниці (2 знаки після коми)
+
+    constexpr Money() = default;
+    static constexpr Money fromMinor(int64_t v) { Money m; m.minor = v; return m; }
+    static constexpr Money fromUnits(int64_t units) { return fromMinor(units * Scale); }
+    // Округлення до найближчої мінімальної одиниці (лише для старих даних у double)
+    static Money fromDouble(double v) { return fromMinor(llround(v * Scale)); }
+
+    constexpr int64_t minorUnits() const { return minor; }
+    double toDouble() const { return static_cast<double>(minor) / Scale; }
+
+    constexpr Money operator-() const { return fromMinor(-minor); }
+    constexpr Money operator+(Money o) const { return fromMinor(minor + o.minor); }
+    constexpr Money operator-(Money o) const { return fromMinor(minor - o.minor); }
+    Money& operator+=(Money o) { minor += o.minor; return *this; }
+    Money& operator-=(Money o) { minor -= o.minor; return *this; }
+
+    // Сума і різниця з перевіркою переповнення: false - результат не вміщується в int64
+    static bool add(Money a, Money b, Money& out) {
+        if (b.minor > 0 ? a.minor > INT64_MAX - b.minor : a.minor < INT64_MIN - b.minor) return false;
+        out = fromMinor(a.minor + b.minor);
+        return true;
+    }
+    static bool subtract(Money a, Money b, Money& out) {
+        if (b.minor > 0 ? a.minor < INT64_MIN + b.minor : a.minor > INT64_MAX + b.minor) return false;
+        out = fromMinor(a.minor - b.minor);
+        return true;
+    }
+    constexpr bool operator==(Money o) const { return minor == o.minor; }
+    constexpr bool operator!=(Money o) const { return minor != o.minor; }
+    constexpr bool operator<(Money o) const { return minor < o.minor; }
+    constexpr bool operator<=(Money o) const { return minor <= o.minor; }
+    constexpr bool operator>(Money o) const { return minor > o.minor; }
+    constexpr bool operator>=(Money o) const { return minor >= o.minor; }
+
+    // Точний розбір десяткового запису: "1234.56", "-12,5" (десяткова кома), "1 234.56" (пробіли
+    // між розрядами), "+7". Більше двох знаків після коми - лише нулі. Без проміжного double.
+    static bool parse(string_view s, Money& out) {
+        size_t i = 0;
+        while (i < s.size() && s[i] == ' ') ++i;
+        bool negative = false;
+        if (i < s.size() && (s[i] == '-' || s[i] == '+')) negative = s[i++] == '-';
+        const int64_t maxUnits = (INT64_MAX - (Scale - 1)) / Scale;
+        int64_t units = 0, fraction = 0;
+        int digits = 0, fractionDigits = 0;
+        bool point = false;
+        for (; i < s.size(); ++i) {
+            char ch = s[i];
+            if (ch == ' ') continue;
+            if (ch == '.' || ch == ',') {
+                if (point) return false;
+                point = true;
+                continue;
+            }
+            if (ch < '0' || ch > '9') return false;
+            int d = ch - '0';
+            ++digits;
+            if (!point) {
+                if (units > (maxUnits - d) / 10) return false; // переповнення
+                units = units * 10 + d;
+            }
+            else if (fractionDigits < 2) { fraction = fraction * 10 + d; ++fractionDigits; }
+            else if (d != 0) return false; // точніше за копійку
+        }
+        if (digits == 0) return false;
+        for (; fractionDigits < 2; ++fractionDigits) fraction *= 10;
+        int64_t v = units * Scale + fraction;
+        out = fromMinor(negative ? -v : v);
+        return true;
+    }
+
+    // Десятковий запис з двома знаками після коми у out (достатньо 24 символів), повертає довжину
+    size_t format(char* out) const {
+        uint64_t v = minor < 0 ? 0 - static_cast<uint64_t>(minor) : static_cast<uint64_t>(minor);
+        char* p = out;
+        if (minor < 0) *p++ = '-';
+        char tmp[24];
+        auto res = to_chars(tmp, tmp + sizeof(tmp), v / Scale);
+        size_t n = static_cast<size_t>(res.ptr - tmp);
+        memcpy(p, tmp, n);
+        p += n;
+        *p++ = '.';
+        *p++ = static_cast<char>('0' + v % Scale / 10);
+        *p++ = static_cast<char>('0' + v % 10);
+        return static_cast<size_t>(p - out);
+    }
+};
+
+inline ostream& operator<<(ostream& os, Money m) {
+    char buf[24];
+    return os.write(buf, static_cast<streamsize>(m.format(buf)));
+}
+
+// Читання суми з потоку (введення користувача); некоректний запис - failbit
+inline istream& operator>>(istream& is, Money& m) {
+    string token;
+    if (is >> token && !Money::parse(token, m)) is.setstate(ios::failbit);
+    return is;
+}
+
+// Позиція курсора у впорядкованому за датою індексі: останній виданий рядок.
+// Серед рядків з однаковою датою номери в індексі зростають, тож пара (дата, номер)
+// однозначно задає місце, навіть якщо індекс між пачками змінився.
+struct IndexPosition {
+    time_t date = 0;
+    RowId row = 0;
+    bool started = false;  // false - ще нічого не видано
+};
+
+// Транзакція: описує одну операцію (витрата або поповнення)
+// Використовується як "матеріалізований" рядок для звітів; самі дані зберігаються у TransactionLedger.
+// Назви не копіюються: це види на інтерновані рядки сховища, дійсні, поки існує це сховище
+// (тобто до знищення менеджера або loadLedgerFromFile).
+struct Transaction {
+    string_view category;    // категорія витрати (їжа, транспорт і т.д.)
+    Money amount;            // сума
+    time_t date;             // дата операції (time_t - число секунд від 1970 року)
+    bool isExpense;          // true = витрата, false = поповнення
+    string_view walletName;  // до якого гаманця/картки відноситься
+
+    // Конструктор за замовчуванням (для сумісності з vector)
+    Transaction() = default;
+
+    // Конструктор з параметрами
+    Transaction(string_view wname, string_view cat, Money amt, bool expense)
+        : category(cat), amount(amt), date(time(nullptr)), // записуємо теперішній час
+        isExpense(expense), walletName(wname) {
+    }
+
+    // Конструктор з явною датою (для відновлення рядка зі стовпців)
+    Transaction(string_view wname, string_view cat, Money amt, bool expense, time_t when)
+        : category(cat), amount(amt), date(when), isExpense(expense), walletName(wname) {
+    }
+};
+
+// Файл, відображений у пам'ять тільки для читання (mmap / MapViewOfFile).
+// Стовпці після завантаження вказують прямо у це відображення, без розбору і копіювання.
+class MappedFile {
+private:
+    const char* ptr = nullptr;
+    size_t len = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (ptr) munmap(const_cast<char*>(ptr), len);
+#endif
+    }
+
+    // Відкриває і відображає файл; false, якщо файл не існує, порожній або не відображається
+    bool open(const string& path) {
+#if defined(_WIN32)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return false;
+        ptr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        len = static_cast<size_t>(size.QuadPart);
+        return ptr != nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return false; }
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // відображення лишається дійсним і після закриття дескриптора
+        if (p == MAP_FAILED) return false;
+        ptr = static_cast<const char*>(p);
+        len = static_cast<size_t>(st.st_size);
+        return true;
+#endif
+    }
+
+    const char* data() const { return ptr; }
+    size_t size() const { return len; }
+};
+
+// Стовпець значень: або власний vector, або масив прямо у відображеному файлі.
+// Читання працює однаково в обох випадках; перша зміна відображеного стовпця
+// копіює його у власну пам'ять (один memcpy), після чого він поводиться як звичайний vector.
+template <class T>
+class Column {
+private:
+    vector<T> owned;             // власні дані
+    const T* mapped = nullptr;   // дані у відображеному файлі (якщо є)
+    size_t mappedCount = 0;
+
+    // Переводить стовпець у власну пам'ять перед зміною
+    void own() {
+        if (!mapped) return;
+        owned.assign(mapped, mapped + mappedCount);
+        mapped = nullptr;
+        mappedCount = 0;
+    }
+
+public:
+    size_t size() const { return mapped ? mappedCount : owned.size(); }
+    bool empty() const { return size() == 0; }
+    const T* data() const { return mapped ? mapped : owned.data(); }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+    const T& operator[](size_t i) const { return data()[i]; }
+    const T& back() const { return data()[size() - 1]; }
+
+    void push_back(const T& v) { own(); owned.push_back(v); }
+    void append(const T* p, size_t n) { own(); owned.insert(owned.end(), p, p + n); }
+    void assign(vector<T>&& v) { owned = move(v); mapped = nullptr; mappedCount = 0; }
+    void reserve(size_t n) { own(); owned.reserve(n); }
+    void insert(size_t pos, const T& v) { own(); owned.insert(owned.begin() + pos, v); }
+    void erase(size_t pos) { own(); owned.erase(owned.begin() + pos); }
+    void clear() { owned.clear(); mapped = nullptr; mappedCount = 0; }
+
+    // Прив'язує стовпець до n значень у відображеному файлі (без копіювання)
+    void attach(const T* p, size_t n) { owned.clear(); owned.shrink_to_fit(); mapped = p; mappedCount = n; }
+};
+
+// Стовпець лише для додавання з незмінними адресами: необов'язкова база (масив у відображеному файлі)
+// плюс блоки фіксованого розміру. Записане значення більше не змінюється і не переміщується,
+// тому читачі можуть читати вже опубліковані рядки без блокування, поки письменник додає нові.
+// Каталог блоків при зростанні копіюється у більший, а старі каталоги живуть до знищення
+// стовпця, тож читач зі старим каталогом теж бачить коректні дані.
+// push_back/attach/clear мають викликатися з одного потоку (під блокуванням власника).
+template <class T>
+class ChunkedColumn {
+public:
+    static constexpr size_t ChunkBits = 12;
+    static constexpr size_t ChunkSize = size_t(1) << ChunkBits;  // елементів у блоці
+    static constexpr size_t ChunkMask = ChunkSize - 1;
+
+private:
+    const T* base = nullptr;                 // масив у відображеному файлі (якщо є)
+    size_t baseCount = 0;
+    vector<unique_ptr<T[]>> chunks;          // власні блоки (володіння)
+    vector<unique_ptr<T*[]>> directories;    // усі каталоги блоків (останній - поточний)
+    size_t directoryCapacity = 0;
+    atomic<T**> directory{ nullptr };        // поточний каталог для читачів
+    atomic<size_t> count{ 0 };               // кількість опублікованих значень
+
+public:
+    ChunkedColumn() = default;
+    ChunkedColumn(const ChunkedColumn&) = delete;
+    ChunkedColumn& operator=(const ChunkedColumn&) = delete;
+
+    size_t size() const { return count.load(memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    const T& operator[](size_t i) const {
+        if (i < baseCount) return base[i];
+        i -= baseCount;
+        return directory.load(memory_order_acquire)[i >> ChunkBits][i & ChunkMask];
+    }
+
+    void push_back(const T& v) {
+        size_t n = count.load(memory_order_relaxed);
+        size_t i = n - baseCount;
+        if ((i & ChunkMask) == 0 && (i >> ChunkBits) == chunks.size()) {
+            if (chunks.size() == directoryCapacity) {
+                // новий каталог удвічі більший; старий лишається живим для поточних читачів
+                size_t cap = directoryCapacity ? directoryCapacity * 2 : 16;
+                unique_ptr<T*[]> dir(new T*[cap]);
+                for (size_t c = 0; c < chunks.size(); ++c) dir[c] = chunks[c].get();
+                directory.store(dir.get(), memory_order_release);
+                directories.push_back(move(dir));
+                directoryCapacity = cap;
+            }
+            chunks.emplace_back(new T[ChunkSize]);
+            directories.back()[chunks.size() - 1] = chunks.back().get();
+        }
+        directory.load(memory_order_relaxed)[i >> ChunkBits][i & ChunkMask] = v;
+        count.store(n + 1, memory_order_release);
+    }
+
+    // Прив'язує стовпець до n значень у відображеному файлі (без копіювання)
+    void attach(const T* p, size_t n) {
+        clear();
+        base = p;
+        baseCount = n;
+        count.store(n, memory_order_release);
+    }
+
+    void clear() {
+        base = nullptr; baseCount = 0;
+        count.store(0, memory_order_release);
+        directory.store(nullptr, memory_order_release);
+        chunks.clear(); directories.clear(); directoryCapacity = 0;
+    }
+
+    // Вказівник на значення i і скільки значень після нього лежать неперервно (не більше to - i)
+    const T* span(size_t i, size_t to, size_t& n) const {
+        if (i < baseCount) { n = min(to, baseCount) - i; return base + i; }
+        size_t k = i - baseCount;
+        n = min(to - i, ChunkSize - (k & ChunkMask));
+        return directory.load(memory_order_acquire)[k >> ChunkBits] + (k & ChunkMask);
+    }
+
+    // Викликає f(ptr, n) для неперервних відрізків значень [from, to)
+    template <class F>
+    void forEachSegment(size_t from, size_t to, F&& f) const {
+        if (from < baseCount) {
+            size_t end = min(to, baseCount);
+            f(base + from, end - from);
+            from = end;
+        }
+        T** dir = directory.load(memory_order_acquire);
+        while (from < to) {
+            size_t i = from - baseCount;
+            size_t n = min(to - from, ChunkSize - (i & ChunkMask));
+            f(dir[i >> ChunkBits] + (i & ChunkMask), n);
+            from += n;
+        }
+    }
+};
+
+// Арена для тексту: рядки складаються підряд у великі блоки, які ніколи не переміщуються,
+// тож string_view на збережений текст лишаються дійсними до clear() або знищення арени.
+// Один malloc на блок замість одного на рядок; звільняється все разом.
+// Не потокобезпечна (власник захищає її своїм блокуванням).
+class StringArena {
+private:
+    vector<unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;  // вільне місце у поточному блоці
+    size_t left = 0;
+
+public:
+    static constexpr size_t BlockBytes = 64 << 10;
+
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    // Копіює s в арену і повертає стабільний вид на копію
+    string_view store(string_view s) {
+        if (s.empty()) return string_view();
+        if (s.size() > left) {
+            if (s.size() > BlockBytes / 4) {
+                // великий рядок - окремий блок, поточний блок далі заповнюється
+                blocks.emplace_back(new char[s.size()]);
+                memcpy(blocks.back().get(), s.data(), s.size());
+                return string_view(blocks.back().get(), s.size());
+            }
+            blocks.emplace_back(new char[BlockBytes]);
+            cursor = blocks.back().get();
+            left = BlockBytes;
+        }
+        memcpy(cursor, s.data(), s.size());
+        string_view stored(cursor, s.size());
+        cursor += s.size();
+        left -= s.size();
+        return stored;
+    }
+
+    void clear() {
+        blocks.clear();
+        cursor = nullptr;
+        left = 0;
+    }
+};
+
+// Словник інтернованих рядків: кожен унікальний рядок зберігається один раз і отримує цілий номер.
+// Текст лежить в арені, тому string_view-ключі хеш-індексу і видані назви не інвалідуються при додаванні.
+// Потокобезпечний: хеш-індекс під shared_mutex, а name(id) читає без блокування
+// через стовпець видів із незмінними адресами.
+class StringDictionary {
+private:
+    StringArena text;                             // байти рядків
+    unordered_map<string_view, uint32_t> index;   // рядок -> ідентифікатор
+    ChunkedColumn<string_view> byId;              // ідентифікатор -> рядок (читання без блокування)
+    mutable shared_mutex mutex;                   // захищає text та index
+
+public:
+    static constexpr uint32_t npos = UINT32_MAX; // "не знайдено"
+
+    // Повертає ідентифікатор рядка, додаючи його за потреби
+    uint32_t intern(string_view s) {
+        {
+            shared_lock<shared_mutex> lock(mutex);
+            auto it = index.find(s);
+            if (it != index.end()) return it->second;
+        }
+        unique_lock<shared_mutex> lock(mutex);
+        auto it = index.find(s); // інший потік міг додати рядок між блокуваннями
+        if (it != index.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(byId.size());
+        string_view stored = text.store(s);
+        index.emplace(stored, id);
+        byId.push_back(stored);
+        return id;
+    }
+
+    // Пошук без додавання (npos, якщо рядка немає)
+    uint32_t find(string_view s) const {
+        shared_lock<shared_mutex> lock(mutex);
+        auto it = index.find(s);
+        return it == index.end() ? npos : it->second;
+    }
+
+    // Назва за номером; вид дійсний, поки словник не очищено
+    string_view name(uint32_t id) const { return byId[id]; }
+    size_t size() const { return byId.size(); }
+
+    void clear() {
+        unique_lock<shared_mutex> lock(mutex);
+        index.clear(); byId.clear(); text.clear();
+    }
+};
+
+// Скидає записане у файл на диск (fflush + fsync); false - помилка запису
+inline bool syncFile(FILE* f) {
+    if (fflush(f) != 0) return false;
+#if defined(_WIN32)
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Обрізає відкритий файл до size байт (наприклад, щоб прибрати недописаний хвіст)
+inline bool truncateFile(FILE* f, uint64_t size) {
+#if defined(_WIN32)
+    return _chsize_s(_fileno(f), static_cast<__int64>(size)) == 0;
+#else
+    return ftruncate(fileno(f), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Скидає на диск каталог, у якому лежить path, щоб перейменування файлу пережило збій.
+// На Windows перейменування з MOVEFILE_WRITE_THROUGH саме чекає на диск.
+inline bool syncParentDirectory(const string& path) {
+#if defined(_WIN32)
+    (void)path;
+    return true;
+#else
+    string dir = filesystem::path(path).parent_path().string();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Послідовний запис бінарного файлу з вирівнюванням секцій стовпців.
+// close() скидає файл на диск, тож після успішного close() вміст переживе збій.
+class BinaryWriter {
+private:
+    FILE* out;
+    uint64_t pos = 0;
+    bool good;
+
+public:
+    explicit BinaryWriter(const string& path) : out(fopen(path.c_str(), "wb")), good(out != nullptr) {
+        if (out) setvbuf(out, nullptr, _IOFBF, 1 << 20);
+    }
+    ~BinaryWriter() { if (out) fclose(out); }
+    BinaryWriter(const BinaryWriter&) = delete;
+    BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+    bool ok() const { return good; }
+
+    void bytes(const void* p, size_t n) {
+        if (good && n && fwrite(p, 1, n, out) != n) good = false;
+        pos += n;
+    }
+    template <class T> void value(const T& v) { bytes(&v, sizeof(T)); }
+    void str(string_view s) { value(static_cast<uint32_t>(s.size())); bytes(s.data(), s.size()); }
+
+    // Вирівнює позицію до 8 байт, щоб стовпці у відображенні можна було читати напряму
+    void align() { static const char zeros[8] = {}; if (pos % 8) bytes(zeros, 8 - pos % 8); }
+
+    // Записує стовпець: кількість + вирівняний масив значень
+    template <class T> void column(const Column<T>& c) {
+        value(static_cast<uint64_t>(c.size()));
+        align();
+        bytes(c.data(), c.size() * sizeof(T));
+    }
+
+    // Записує стовпець з блоків тим самим форматом, що й Column
+    template <class T> void column(const ChunkedColumn<T>& c, size_t n) {
+        value(static_cast<uint64_t>(n));
+        align();
+        c.forEachSegment(0, n, [this](const T* p, size_t k) { bytes(p, k * sizeof(T)); });
+    }
+
+    // Скидає файл на диск і закриває; true - усе записано і збережено
+    bool close() {
+        if (!out) return false;
+        bool ok = good && syncFile(out);
+        ok = fclose(out) == 0 && ok;
+        out = nullptr;
+        return ok;
+    }
+};
+
+// Читання бінарного файлу з відображеної пам'яті з перевіркою меж
+class BinaryReader {
+private:
+    const char* base;
+    size_t len;
+    size_t pos = 0;
+    bool good = true;
+
+public:
+    BinaryReader(const char* p, size_t n) : base(p), len(n) {}
+    bool ok() const { return good; }
+
+    const char* bytes(size_t n) {
+        if (!good || n > len - pos) { good = false; return nullptr; }
+        const char* p = base + pos;
+        pos += n;
+        return p;
+    }
+    template <class T> T value() {
+        T v{};
+        if (const char* p = bytes(sizeof(T))) memcpy(&v, p, sizeof(T));
+        return v;
+    }
+    string str() { return string(view()); }
+
+    // Кількість елементів, кожен з яких займає у файлі щонайменше itemBytes байт.
+    // Кількість, що не вміщується у решту файлу, робить читач недійсним (і повертається 0),
+    // тож пошкоджене число не призводить до величезного виділення пам'яті.
+    template <class T> T count(size_t itemBytes) {
+        T n = value<T>();
+        if (good && n > (len - pos) / itemBytes) good = false;
+        return good ? n : 0;
+    }
+
+    // Рядок без копіювання: вид на дані читача
+    string_view view() {
+        uint32_t n = value<uint32_t>();
+        const char* p = bytes(n);
+        return p ? string_view(p, n) : string_view();
+    }
+    void align() { if (pos % 8) bytes(8 - pos % 8); }
+
+    // Прив'язує стовпець до даних у відображенні (без копіювання)
+    template <class C> void column(C& c) {
+        using T = typename remove_const<typename remove_reference<decltype(c[0])>::type>::type;
+        uint64_t n = value<uint64_t>();
+        align();
+        if (!good || n > (len - pos) / sizeof(T)) { good = false; return; }
+        c.attach(reinterpret_cast<const T*>(bytes(static_cast<size_t>(n * sizeof(T)))), static_cast<size_t>(n));
+    }
+};
+
+// Журнал операцій (write-ahead log): кожна зміна дописується в кінець файлу.
+// Записи накопичуються у буфері і скидаються на диск пачкою (груповий коміт):
+// один послідовний запис і один fsync на пачку, а не на кожну транзакцію.
+// Формат запису: [u32 довжина][u32 контрольна сума][дані]; обірваний хвіст після збою відкидається.
+// Потокобезпечний: запис у буфер і скидання на диск мають окремі блокування, тож поки
+// один потік робить fsync, інші продовжують додавати записи у наступну пачку.
+// Фоновий потік скидає пачку, старшу за GroupCommitInterval, навіть якщо нових записів немає:
+// прийнята операція потрапляє на диск не пізніше ніж через інтервал (плюс час самого fsync).
+class Journal {
+public:
+    enum class RecordType : uint8_t { ADD_WALLET = 1, TRANSACTION = 2, CANCEL = 3, BUDGET = 4 };
+
+    // Прапорці запису TRANSACTION
+    static constexpr uint8_t FlagExpense = 1;        // витрата (інакше поповнення)
+    static constexpr uint8_t FlagAffectsBalance = 2; // операція змінює баланс (deposit/spend)
+    // Сума записана у мінімальних одиницях (Money); у старих записах без прапорця - double.
+    // Ставиться і знімається самим журналом, назовні не видно.
+    static constexpr uint8_t FlagMinorUnits = 0x80;
+
+    // Один запис журналу; значення полів залежить від типу
+    struct Record {
+        uint64_t lsn = 0;              // порядковий номер зміни
+        RecordType type = RecordType::TRANSACTION;
+        WalletId wallet = 0;           // гаманець (для CANCEL - власник рядка, для BUDGET npos - усі)
+        Money amount;                  // сума, кредитний ліміт (ADD_WALLET) або ліміт бюджету (BUDGET)
+        time_t date = 0;               // дата операції (BUDGET - поріг попередження в мільйонних частках ліміту)
+        uint8_t flags = 0;             // FlagExpense/FlagAffectsBalance, тип гаманця (ADD_WALLET) або період (BUDGET)
+        RowId row = 0;                 // скасований рядок (CANCEL)
+        string_view text;              // категорія (для BUDGET порожня - усі) або ім'я гаманця (не копіюється: дійсне на час виклику)
+    };
+
+    // Параметри групового коміту
+    static constexpr size_t GroupCommitOps = 256;          // скидати після стількох записів
+    static constexpr size_t GroupCommitBytes = 1 << 20;    // або після стількох байт
+    static constexpr chrono::milliseconds GroupCommitInterval{ 50 }; // або якщо пачка старша за це
+
+private:
+    FILE* file = nullptr;          // під ioMutex
+    string buffer;                 // записи, що ще не скинуті на диск (під bufferMutex)
+    size_t pendingOps = 0;
+    chrono::steady_clock::time_point batchStart;
+    atomic<uint64_t> fileBytes{ 0 }; // розмір файлу журналу на диску
+    mutable mutex bufferMutex;     // захищає buffer/pendingOps/batchStart/stopping
+    mutex ioMutex;                 // захищає file; пачки пишуться по черзі
+    thread flusher;                // скидає пачки за віком (між open і close)
+    condition_variable flushWake;  // нова пачка або зупинка
+    bool stopping = false;
+    bool broken = false;           // хвіст файлу не вдалося прибрати після збою запису (під ioMutex)
+
+    // FNV-1a: проста контрольна сума для виявлення обірваних записів
+    static uint32_t checksum(const char* p, size_t n) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; ++i) { h ^= static_cast<uint8_t>(p[i]); h *= 16777619u; }
+        return h;
+    }
+
+    template <class T> static void put(string& out, const T& v) { out.append(reinterpret_cast<const char*>(&v), sizeof(T)); }
+
+    // Забирає поточну пачку і скидає її у файл і на диск (ioMutex має бути захоплений).
+    // Якщо запис або fsync не вдався, пачка не втрачається: недописаний хвіст обрізається
+    // до попереднього розміру (щоб наступні пачки не лягли після обірваного запису, на якому
+    // зупиниться відтворення), а пачка повертається в буфер перед новими записами і
+    // пишеться заново наступним sync(). Якщо обрізати не вдалося, журнал більше нічого
+    // не дописує, поки його не очистить truncate() після ущільнення у знімок.
+    bool flushLocked() {
+        if (!file || broken) return false;
+        string batch;
+        size_t ops;
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            batch.swap(buffer);
+            ops = pendingOps;
+            pendingOps = 0;
+        }
+        if (batch.empty()) return true;
+        if (fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file)) {
+            fileBytes += batch.size();
+            return true;
+        }
+        clearerr(file);
+        broken = !truncateFile(file, fileBytes.load());
+        lock_guard<mutex> lock(bufferMutex);
+        buffer.insert(0, batch);
+        pendingOps += ops;
+        batchStart = chrono::steady_clock::now(); // фоновий потік повторить через інтервал, а не одразу
+        return false;
+    }
+
+    // Фоновий потік: чекає на першу операцію пачки і скидає пачку, коли їй виповнюється інтервал
+    void flushLoop() {
+        unique_lock<mutex> lock(bufferMutex);
+        while (!stopping) {
+            if (pendingOps == 0) { flushWake.wait(lock); continue; }
+            auto due = batchStart + GroupCommitInterval;
+            if (chrono::steady_clock::now() < due) { flushWake.wait_until(lock, due); continue; }
+            lock.unlock();
+            sync();
+            lock.lock();
+        }
+    }
+
+    void stopFlusher() {
+        {
+            lock_guard<mutex> lock(bufferMutex);
+            stopping = true;
+        }
+        flushWake.notify_all();
+        if (flusher.joinable()) flusher.join();
+    }
+
+public:
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal() { close(); }
+
+    // Читає всі цілі записи журналу і передає їх у f(record).
+    // Повертає довжину коректної частини файлу (усе після неї - обірваний хвіст).
+    template <class F>
+    static uint64_t replay(const string& path, F&& f) {
+        ifstream in(path, ios::binary);
+        if (!in) return 0;
+        error_code ec;
+        uint64_t fileSize = filesystem::file_size(path, ec);
+        if (ec) return 0;
+        uint64_t valid = 0;
+        string payload;
+        while (true) {
+            uint32_t len = 0, sum = 0;
+            if (!in.read(reinterpret_cast<char*>(&len), sizeof(len))) break;
+            if (!in.read(reinterpret_cast<char*>(&sum), sizeof(sum))) break;
+            // пошкоджена довжина не повинна призводити до величезного виділення пам'яті
+            if (len > fileSize - valid - sizeof(len) - sizeof(sum)) break;
+            payload.resize(len);
+            if (!in.read(&payload[0], len) || checksum(payload.data(), len) != sum) break;
+            BinaryReader r(payload.data(), payload.size());
+            Record rec;
+            rec.lsn = r.value<uint64_t>();
+            rec.type = static_cast<RecordType>(r.value<uint8_t>());
+            rec.wallet = r.value<WalletId>();
+            uint64_t amountBits = r.value<uint64_t>();
+            rec.date = r.value<time_t>();
+            rec.flags = r.value<uint8_t>();
+            if (rec.flags & FlagMinorUnits) rec.amount = Money::fromMinor(static_cast<int64_t>(amountBits));
+            else {
+                double legacy;
+                memcpy(&legacy, &amountBits, sizeof(legacy));
+                rec.amount = Money::fromDouble(legacy);
+            }
+            rec.flags &= static_cast<uint8_t>(~FlagMinorUnits);
+            rec.row = r.value<RowId>();
+            rec.text = r.view(); // вказує у payload, дійсний під час f(rec)
+            if (!r.ok()) break;
+            f(rec);
+            valid += sizeof(len) + sizeof(sum) + len;
+        }
+        return valid;
+    }
+
+    // Відкриває журнал для дописування, обрізаючи його до validBytes (відкидає обірваний хвіст)
+    bool open(const string& path, uint64_t validBytes) {
+        close();
+        lock_guard<mutex> lock(ioMutex);
+        error_code ec;
+        if (filesystem::exists(path, ec)) filesystem::resize_file(path, validBytes, ec);
+        if (ec) return false;
+        file = fopen(path.c_str(), "ab");
+        if (!file) return false;
+        setvbuf(file, nullptr, _IONBF, 0); // буферизуємо самі
+        fileBytes = validBytes;
+        broken = false;
+        stopping = false; // попередній потік уже зупинено у close()
+        flusher = thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    // Додає запис у поточну пачку. Повертає true, якщо пачку пора скинути на диск
+    // (набралося достатньо записів/байт) - тоді викликач робить sync() уже після того,
+    // як відпустив власні блокування. Пачки за віком скидає фоновий потік, тож годинник
+    // читається лише на першому записі пачки (append викликається під блокуванням сховища).
+    bool append(const Record& rec) {
+        lock_guard<mutex> lock(bufferMutex);
+        if (pendingOps == 0) {
+            batchStart = chrono::steady_clock::now();
+            flushWake.notify_one(); // фоновий потік відлічує вік нової пачки
+        }
+        size_t at = buffer.size();
+        put(buffer, uint32_t(0)); // місце під довжину і контрольну суму
+        put(buffer, uint32_t(0));
+        put(buffer, rec.lsn);
+        put(buffer, static_cast<uint8_t>(rec.type));
+        put(buffer, rec.wallet);
+        put(buffer, rec.amount.minorUnits());
+        put(buffer, rec.date);
+        put(buffer, static_cast<uint8_t>(rec.flags | FlagMinorUnits));
+        put(buffer, rec.row);
+        put(buffer, static_cast<uint32_t>(rec.text.size()));
+        buffer.append(rec.text);
+        uint32_t len = static_cast<uint32_t>(buffer.size() - at - 8);
+        uint32_t sum = checksum(buffer.data() + at + 8, len);
+        memcpy(&buffer[at], &len, sizeof(len));
+        memcpy(&buffer[at + 4], &sum, sizeof(sum));
+        ++pendingOps;
+        return pendingOps >= GroupCommitOps || buffer.size() >= GroupCommitBytes;
+    }
+
+    // Примусово скидає поточну пачку на диск; false - пачку не записано (вона лишається в буфері)
+    bool sync() {
+        lock_guard<mutex> lock(ioMutex);
+        return flushLocked();
+    }
+
+    // Розмір журналу (на диску + у буфері)
+    uint64_t size() const {
+        lock_guard<mutex> lock(bufferMutex);
+        return fileBytes + buffer.size();
+    }
+
+    // Очищає журнал після того, як його вміст потрапив у знімок.
+    // Викликач гарантує, що нових записів у цей момент немає.
+    bool truncate(const string& path) {
+        lock_guard<mutex> lock(ioMutex);
+        if (file) { fclose(file); file = nullptr; }
+        {
+            lock_guard<mutex> bufLock(bufferMutex);
+            buffer.clear();
+            pendingOps = 0;
+        }
+        file = fopen(path.c_str(), "wb");
+        if (!file) return false;
+        setvbuf(file, nullptr, _IONBF, 0);
+        fileBytes = 0;
+        broken = false;
+        return true;
+    }
+
+    void close() {
+        stopFlusher();
+        lock_guard<mutex> lock(ioMutex);
+        if (!file) return;
+        flushLocked();
+        fclose(file);
+        file = nullptr;
+    }
+};
+
+// Номер доби (UTC) для дати; ділення з округленням вниз, щоб дати до 1970 року теж працювали
+inline int64_t dayOf(time_t t) {
+    const int64_t secondsPerDay = 24 * 60 * 60;
+    int64_t s = static_cast<int64_t>(t);
+    return (s >= 0 ? s : s - secondsPerDay + 1) / secondsPerDay;
+}
+
+// Агрегати витрат, що оновлюються при кожному додаванні/видаленні рядка:
+// суми по категоріях за кожну добу, загальні суми по категоріях і обмежена купа найбільших витрат.
+// Завдяки цьому TOP-звіти не перераховують усю історію.
+class ExpenseAggregates {
+public:
+    // Сума і кількість витрат однієї категорії
+    struct Bucket {
+        Money sum;
+        uint32_t count = 0;
+    };
+
+    // Скільки найбільших витрат тримаємо у купі (запити з більшим topN рахуються окремо)
+    static constexpr size_t TopCapacity = 32;
+
+private:
+    map<int64_t, vector<Bucket>> days;   // доба -> (CategoryId -> сума за добу)
+    vector<Bucket> totals;                // CategoryId -> сума за весь час
+    vector<pair<Money, RowId>> topHeap;   // мін-купа (сума, рядок) найбільших витрат
+
+    static bool heapLess(const pair<Money, RowId>& a, const pair<Money, RowId>& b) {
+        return a.first > b.first; // "менший" елемент - на вершині купи
+    }
+
+    static void add(vector<Bucket>& v, CategoryId c, Money amt, int sign) {
+        if (v.size() <= c) v.resize(c + 1);
+        v[c].sum += sign > 0 ? amt : -amt;
+        v[c].count = sign > 0 ? v[c].count + 1 : v[c].count - 1;
+    }
+
+public:
+    // Врахувати новий рядок-витрату
+    void onInsert(RowId r, time_t date, CategoryId c, Money amt) {
+        add(days[dayOf(date)], c, amt, +1);
+        add(totals, c, amt, +1);
+        offerTop(amt, r);
+    }
+
+    // Прибрати рядок-витрату; повертає true, якщо він був у купі (тоді купу треба перебудувати)
+    bool onRemove(RowId r, time_t date, CategoryId c, Money amt) {
+        auto it = days.find(dayOf(date));
+        if (it != days.end()) {
+            add(it->second, c, amt, -1);
+            bool emptyDay = true;
+            for (const auto& b : it->second) if (b.count) { emptyDay = false; break; }
+            if (emptyDay) days.erase(it);
+        }
+        add(totals, c, amt, -1);
+        for (const auto& e : topHeap) if (e.second == r) return true;
+        return false;
+    }
+
+    // Запропонувати витрату для купи найбільших
+    void offerTop(Money amt, RowId r) {
+        if (topHeap.size() < TopCapacity) {
+            topHeap.emplace_back(amt, r);
+            push_heap(topHeap.begin(), topHeap.end(), heapLess);
+        }
+        else if (amt > topHeap.front().first) {
+            pop_heap(topHeap.begin(), topHeap.end(), heapLess);
+            topHeap.back() = { amt, r };
+            push_heap(topHeap.begin(), topHeap.end(), heapLess);
+        }
+    }
+
+    void clearTop() { topHeap.clear(); }
+
+    // Найбільші витрати за весь час (до TopCapacity штук), за спаданням суми
+    vector<RowId> topRows(size_t n) const {
+        auto sorted = topHeap;
+        sort(sorted.begin(), sorted.end(), heapLess);
+        vector<RowId> res;
+        for (size_t i = 0; i < sorted.size() && i < n; ++i) res.push_back(sorted[i].second);
+        return res;
+    }
+
+    // Суми по категоріях за весь час
+    const vector<Bucket>& allTime() const { return totals; }
+
+    // Запис агрегатів у бінарний файл (їх мало: кількість діб x кількість категорій)
+    void save(BinaryWriter& w) const {
+        auto buckets = [&w](const vector<Bucket>& v) {
+            w.value(static_cast<uint32_t>(v.size()));
+            for (const auto& b : v) { w.value(b.sum); w.value(b.count); }
+        };
+        w.value(static_cast<uint64_t>(days.size()));
+        for (const auto& d : days) { w.value(d.first); buckets(d.second); }
+        buckets(totals);
+        w.value(static_cast<uint32_t>(topHeap.size()));
+        for (const auto& e : topHeap) { w.value(e.first); w.value(e.second); }
+    }
+
+    // Читання агрегатів з бінарного файлу (legacy - суми записані як double, формат до версії 3)
+    void load(BinaryReader& r, bool legacy) {
+        auto amount = [&r, legacy]() { return legacy ? Money::fromDouble(r.value<double>()) : r.value<Money>(); };
+        const size_t bucketBytes = 8 + sizeof(uint32_t); // сума (Money або double) + кількість
+        auto buckets = [&r, &amount, bucketBytes](vector<Bucket>& v) {
+            uint32_t n = r.count<uint32_t>(bucketBytes);
+            v.reserve(n);
+            for (uint32_t i = 0; i < n && r.ok(); ++i) {
+                Bucket b;
+                b.sum = amount();
+                b.count = r.value<uint32_t>();
+                v.push_back(b);
+            }
+        };
+        days.clear(); totals.clear(); topHeap.clear();
+        uint64_t dayCount = r.count<uint64_t>(sizeof(int64_t) + sizeof(uint32_t));
+        for (uint64_t i = 0; i < dayCount && r.ok(); ++i) {
+            int64_t day = r.value<int64_t>();
+            buckets(days[day]);
+        }
+        buckets(totals);
+        uint32_t heapSize = r.count<uint32_t>(8 + sizeof(RowId));
+        for (uint32_t i = 0; i < heapSize && r.ok(); ++i) {
+            Money amt = amount();
+            topHeap.emplace_back(amt, r.value<RowId>());
+        }
+    }
+
+    // Чи узгоджені прочитані агрегати зі сховищем з rows рядків і categories категорій
+    // (інакше звіти звернулися б до неіснуючої категорії або рядка), а суми - з обсягом
+    // усіх рядків volume (інакше подальші суми могли б переповнитися)
+    bool valid(size_t rows, size_t categories, Money volume) const {
+        auto bounded = [volume](const vector<Bucket>& v) {
+            for (const auto& b : v) if (b.sum < -volume || b.sum > volume) return false;
+            return true;
+        };
+        if (totals.size() > categories || topHeap.size() > TopCapacity || !bounded(totals)) return false;
+        for (const auto& d : days) if (d.second.size() > categories || !bounded(d.second)) return false;
+        for (const auto& e : topHeap) if (e.second >= rows) return false;
+        return is_heap(topHeap.begin(), topHeap.end(), heapLess);
+    }
+
+    // Додає до out суми всіх діб, що йдуть після доби firstDay - 1 (тобто з firstDay включно)
+    void addDaysFrom(int64_t firstDay, vector<Bucket>& out) const {
+        for (auto it = days.lower_bound(firstDay); it != days.end(); ++it) {
+            if (out.size() < it->second.size()) out.resize(it->second.size());
+            for (size_t c = 0; c < it->second.size(); ++c) {
+                out[c].sum += it->second[c].sum;
+                out[c].count += it->second[c].count;
+            }
+        }
+    }
+};
+
+// Гранулярність календарних рядів
+enum class SeriesGranularity { DAY, WEEK, MONTH };
+
+// Календарні періоди за місцевим часом: доба - номер дня від 1970-01-01 за місцевим календарем,
+// тиждень починається з понеділка, місяць - рік * 12 + (місяць - 1).
+// Межі останньої доби кешуються (localtime/mktime лише при зміні доби), тож дати,
+// що йдуть підряд, перетворюються без звернень до бібліотеки часу. Межі доби беруться з mktime,
+// тому доби переходу на літній/зимовий час (23 і 25 годин) теж рахуються правильно.
+class LocalCalendar {
+private:
+    time_t dayStart = 0, dayEnd = 0;  // закешована доба [dayStart, dayEnd)
+    int64_t day = 0;
+
+    static int64_t floorDiv(int64_t a, int64_t b) { return (a >= 0 ? a : a - b + 1) / b; }
+
+public:
+    // Номер доби для дати за григоріанським календарем
+    static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        const int64_t era = floorDiv(y, 400);
+        const unsigned yoe = static_cast<unsigned>(y - era * 400);
+        const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+
+    // Дата (рік, місяць, день) для номера доби
+    static void civilFromDays(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+        z += 719468;
+        const int64_t era = floorDiv(z, 146097);
+        const unsigned doe = static_cast<unsigned>(z - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+    }
+
+    // Номер місцевої календарної доби для дати
+    int64_t dayOf(time_t t) {
+        if (t >= dayStart && t < dayEnd) return day;
+        tm local_tm;
+#if defined(_MSC_VER)   // для MSVC
+        localtime_s(&local_tm, &t);
+#else                  // для Linux/Mingw
+        localtime_r(&t, &local_tm);
+#endif
+        day = daysFromCivil(local_tm.tm_year + 1900, static_cast<unsigned>(local_tm.tm_mon + 1), static_cast<unsigned>(local_tm.tm_mday));
+        tm bound{};
+        bound.tm_year = local_tm.tm_year;
+        bound.tm_mon = local_tm.tm_mon;
+        bound.tm_mday = local_tm.tm_mday;
+        bound.tm_isdst = -1;
+        dayStart = mktime(&bound);
+        bound = tm{};
+        bound.tm_year = local_tm.tm_year;
+        bound.tm_mon = local_tm.tm_mon;
+        bound.tm_mday = local_tm.tm_mday + 1;
+        bound.tm_isdst = -1;
+        dayEnd = mktime(&bound);
+        if (!(t >= dayStart && t < dayEnd)) dayStart = dayEnd = 0; // не кешуємо, якщо межі не вдалося визначити
+        return day;
+    }
+
+    // Номер періоду, що містить доба
+    static int64_t periodOfDay(int64_t d, SeriesGranularity g) {
+        switch (g) {
+        case SeriesGranularity::WEEK: return floorDiv(d + 3, 7); // 1970-01-01 - четвер
+        case SeriesGranularity::MONTH: {
+            int64_t y; unsigned m, dd;
+            civilFromDays(d, y, m, dd);
+            return y * 12 + (m - 1);
+        }
+        default: return d;
+        }
+    }
+
+    int64_t periodOf(time_t t, SeriesGranularity g) { return periodOfDay(dayOf(t), g); }
+
+    // Перша доба періоду
+    static int64_t firstDayOf(int64_t period, SeriesGranularity g) {
+        switch (g) {
+        case SeriesGranularity::WEEK: return period * 7 - 3;
+        case SeriesGranularity::MONTH: {
+            int64_t y = floorDiv(period, 12);
+            return daysFromCivil(y, static_cast<unsigned>(period - y * 12 + 1), 1);
+        }
+        default: return period;
+        }
+    }
+
+    // Назва періоду: "YYYY-MM-DD" для доби і тижня (понеділок), "YYYY-MM" для місяця; повертає довжину
+    static size_t label(int64_t period, SeriesGranularity g, char* out) {
+        int64_t y; unsigned m, d;
+        civilFromDays(firstDayOf(period, g), y, m, d);
+        int n = g == SeriesGranularity::MONTH
+            ? snprintf(out, 16, "%04lld-%02u", static_cast<long long>(y), m)
+            : snprintf(out, 16, "%04lld-%02u-%02u", static_cast<long long>(y), m, d);
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+};
+
+// Одна точка календарного ряду витрат
+struct SeriesPoint {
+    int64_t period;   // номер періоду (див. LocalCalendar)
+    Money sum;
+    uint32_t count;
+};
+
+// Бюджет: ліміт витрат за календарний період для гаманця і/або категорії (npos - усі).
+// Попередження - коли витрати періоду переходять warnRatio від ліміту, тривога - коли сам ліміт.
+struct Budget {
+    WalletId wallet = StringDictionary::npos;
+    CategoryId category = StringDictionary::npos;
+    SeriesGranularity granularity = SeriesGranularity::MONTH;
+    Money limit;
+    double warnRatio = 0.8;
+
+    // Чи можна прийняти бюджет (зі знімка чи журналу): додатний ліміт, відомий період,
+    // поріг попередження в [0, 1]; гаманець і категорія перевіряються окремо
+    bool valid() const {
+        return limit > Money() && granularity >= SeriesGranularity::DAY && granularity <= SeriesGranularity::MONTH
+            && warnRatio >= 0 && warnRatio <= 1;
+    }
+};
+
+// Спрацювання бюджету на конкретній витраті
+struct BudgetAlert {
+    Budget budget;
+    int64_t period;   // період, у якому перейдено поріг
+    Money spent;      // витрати періоду після операції
+    bool exceeded;    // true - перейдено ліміт, false - поріг попередження
+};
+
+// Попередньо згруповані суми витрат за календарними добами, тижнями і місяцями.
+// Для кожного періоду зберігаються загальна сума, суми по категоріях і клітинки (гаманець, категорія),
+// тож точка ряду без фільтра або з фільтром категорії - одне читання, а з фільтром гаманця -
+// прохід лише по клітинках цього гаманця. Ряд за роки читається з кількох сотень кошиків
+// замість проходу по рядках сховища; оновлюються разом із рядками.
+class SpendingRollups {
+public:
+    using Bucket = ExpenseAggregates::Bucket;
+
+    struct Cell {
+        WalletId wallet;
+        CategoryId category;
+        Bucket sum;
+    };
+
+    struct Period {
+        Bucket total;              // усі гаманці й категорії
+        vector<Bucket> byCategory; // CategoryId -> сума
+        vector<Cell> cells;        // впорядковані за (гаманець, категорія)
+    };
+
+private:
+    static constexpr int LevelCount = 3;
+
+    map<int64_t, Period> levels[LevelCount];  // [гранулярність] період -> кошики
+    LocalCalendar calendar;
+
+    // Останні оновлені періоди: нові рядки майже завжди потрапляють у поточну добу,
+    // тож пошук у map і перерахунок тижня/місяця потрібні лише при зміні доби
+    int64_t lastDay = INT64_MIN;
+    Period* lastPeriods[LevelCount] = {};
+
+    static void add(Bucket& b, Money amt, int sign) {
+        b.sum += sign > 0 ? amt : -amt;
+        b.count = sign > 0 ? b.count + 1 : b.count - 1;
+    }
+
+    static bool cellLess(const Cell& a, const pair<WalletId, CategoryId>& key) {
+        return a.wallet != key.first ? a.wallet < key.first : a.category < key.second;
+    }
+
+    static void add(Period& p, WalletId w, CategoryId c, Money amt, int sign) {
+        add(p.total, amt, sign);
+        if (p.byCategory.size() <= c) p.byCategory.resize(c + 1);
+        add(p.byCategory[c], amt, sign);
+        auto it = lower_bound(p.cells.begin(), p.cells.end(), make_pair(w, c), cellLess);
+        if (it == p.cells.end() || it->wallet != w || it->category != c) it = p.cells.insert(it, Cell{ w, c, Bucket() });
+        add(it->sum, amt, sign);
+    }
+
+    void update(time_t date, WalletId w, CategoryId c, Money amt, int sign) {
+        int64_t day = calendar.dayOf(date);
+        if (day != lastDay) {
+            for (int g = 0; g < LevelCount; ++g)
+                lastPeriods[g] = &levels[g][LocalCalendar::periodOfDay(day, static_cast<SeriesGranularity>(g))];
+            lastDay = day;
+        }
+        for (Period* p : lastPeriods) add(*p, w, c, amt, sign);
+    }
+
+    // Сума періоду для фільтра
+    static Bucket sum(const Period& p, WalletId w, CategoryId c) {
+        if (w == StringDictionary::npos) {
+            if (c == StringDictionary::npos) return p.total;
+            return c < p.byCategory.size() ? p.byCategory[c] : Bucket();
+        }
+        Bucket b;
+        for (auto it = lower_bound(p.cells.begin(), p.cells.end(), make_pair(w, CategoryId(0)), cellLess);
+            it != p.cells.end() && it->wallet == w; ++it) { // клітинки гаманця йдуть підряд
+            if (c != StringDictionary::npos && it->category != c) continue;
+            b.sum += it->sum.sum;
+            b.count += it->sum.count;
+        }
+        return b;
+    }
+
+public:
+    void onInsert(time_t date, WalletId w, CategoryId c, Money amt) { update(date, w, c, amt, +1); }
+    void onRemove(time_t date, WalletId w, CategoryId c, Money amt) { update(date, w, c, amt, -1); }
+
+    void clear() {
+        for (auto& l : levels) l.clear();
+        lastDay = INT64_MIN;
+    }
+
+    int64_t periodOf(time_t date, SeriesGranularity g) { return calendar.periodOf(date, g); }
+
+    // Витрати одного періоду для фільтра
+    Bucket total(SeriesGranularity g, int64_t period, WalletId w, CategoryId c) const {
+        const auto& level = levels[static_cast<int>(g)];
+        auto it = level.find(period);
+        return it == level.end() ? Bucket() : sum(it->second, w, c);
+    }
+
+    // Ряд для періодів [first, last], порожні періоди - нулі
+    vector<SeriesPoint> series(SeriesGranularity g, int64_t first, int64_t last, WalletId w, CategoryId c) const {
+        vector<SeriesPoint> points;
+        if (last < first) return points;
+        points.reserve(static_cast<size_t>(last - first + 1));
+        for (int64_t p = first; p <= last; ++p) points.push_back(SeriesPoint{ p, Money(), 0 });
+        const auto& level = levels[static_cast<int>(g)];
+        for (auto it = level.lower_bound(first); it != level.end() && it->first <= last; ++it) {
+            Bucket b = sum(it->second, w, c);
+            points[static_cast<size_t>(it->first - first)].sum = b.sum;
+            points[static_cast<size_t>(it->first - first)].count = b.count;
+        }
+        return points;
+    }
+};
+
+// Ядра підсумовування над неперервними відрізками стовпців.
+// Усередині циклу немає розгалужень: умова фільтра стає маскою (0 або -1) і накладається
+// на цілу суму через "і", тож компілятор перетворює цикл на SIMD-інструкції.
+// npos у wallet/category - без фільтра за цим полем.
+
+// Сума і кількість витрат однієї категорії
+inline ExpenseAggregates::Bucket maskedExpenseSum(const Money* amounts, const uint8_t* expense,
+    const WalletId* wallets, const CategoryId* categories, size_t n, WalletId wallet, CategoryId category) {
+    const bool anyWallet = wallet == StringDictionary::npos;
+    int64_t sum = 0;
+    uint32_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t hit = static_cast<uint32_t>(expense[i] != 0) & static_cast<uint32_t>(categories[i] == category)
+            & static_cast<uint32_t>(anyWallet | (wallets[i] == wallet));
+        sum += amounts[i].minorUnits() & -static_cast<int64_t>(hit);
+        count += hit;
+    }
+    ExpenseAggregates::Bucket b;
+    b.sum = Money::fromMinor(sum);
+    b.count = count;
+    return b;
+}
+
+// Суми і кількості витрат по всіх категоріях (sums - масив за CategoryId)
+inline void expenseSumsByCategory(const Money* amounts, const uint8_t* expense,
+    const WalletId* wallets, const CategoryId* categories, size_t n, WalletId wallet, ExpenseAggregates::Bucket* sums) {
+    const bool anyWallet = wallet == StringDictionary::npos;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t hit = static_cast<uint32_t>(expense[i] != 0) & static_cast<uint32_t>(anyWallet | (wallets[i] == wallet));
+        ExpenseAggregates::Bucket& b = sums[categories[i]];
+        b.sum += Money::fromMinor(amounts[i].minorUnits() & -static_cast<int64_t>(hit));
+        b.count += hit;
+    }
+}
+
+// Центральне сховище транзакцій у вигляді окремих щільних стовпців (structure-of-arrays).
+// Рядки тільки додаються в кінець, тому номер рядка (RowId) ніколи не змінюється.
+// Часовий індекс (byDate) тримає номери рядків, впорядковані за датою, щоб період
+// "останні N днів" знаходився бінарним пошуком як неперервний відрізок.
+//
+// Потокобезпечність: стовпці даних - ChunkedColumn, записаний рядок більше не змінюється,
+// тому amountAt()/dateAt()/... читаються без блокування. Індекси, агрегати і журнал
+// змінюються під unique-блокуванням, а запити читають їх під shared-блокуванням.
+// Це блокування одне на все сховище: кожен новий рядок отримує глобальний номер, місце
+// у byDate, кошики агрегатів і позицію в журналі, тож записи в різні гаманці виконуються
+// по черзі. Тому під ним лише сама вставка; перевірки, розбір і fsync - поза ним.
+class TransactionLedger {
+private:
+    ChunkedColumn<Money> amounts;           // суми
+    ChunkedColumn<time_t> dates;            // дати операцій
+    ChunkedColumn<uint8_t> expenseFlags;    // 1 = витрата, 0 = поповнення
+    ChunkedColumn<uint8_t> balanceFlags;    // 1 = операція змінила баланс гаманця, 0 = історичний запис
+    ChunkedColumn<WalletId> walletIds;      // гаманець, якому належить рядок
+    ChunkedColumn<CategoryId> categoryIds;  // категорія рядка
+    // Кількість рядків, уже записаних в усі стовпці. Стовпці публікують значення по одному,
+    // тому читачі без блокування беруть межу звідси, а не з розміру окремого стовпця.
+    atomic<size_t> rowCount{ 0 };
+    // Сума модулів усіх записаних сум (разом зі скасованими рядками). Баланси, агрегати,
+    // ряди і суми запитів - часткові суми рядків, тож за модулем не більші за неї: поки обсяг
+    // вміщується в Money, жодна з них не переповнюється. Операції резервують суму до запису.
+    atomic<int64_t> volume{ 0 };
+
+    Column<RowId> byDate;            // номери рядків, відсортовані за датою
+    size_t removedCount = 0;         // скільки рядків скасовано (вони лишаються у стовпцях, але не в індексах)
+    ExpenseAggregates aggregates;    // поточні агрегати витрат
+
+    StringDictionary categories;     // інтерновані назви категорій
+    StringDictionary walletNames;    // інтерновані імена гаманців (ідентифікатор = WalletId)
+
+    shared_ptr<const MappedFile> mapping; // відображений файл, на який можуть вказувати стовпці
+
+    Journal* journal = nullptr;      // журнал операцій (якщо підключений)
+    uint64_t lastLsn = 0;            // номер останньої зміни (зберігається у знімку)
+
+    mutable shared_mutex mutex;      // захищає byDate, removedCount, aggregates, lastLsn і порядок журналу
+
+    // Календарні ряди будуються при першому запиті (хто ними не користується, не платить
+    // за їх оновлення), далі оновлюються разом із рядками. Захищені mutex, як і aggregates.
+    mutable SpendingRollups rollups;
+    mutable bool rollupsReady = false;
+    vector<Budget> budgets;              // бюджети, що перевіряються на кожній витраті
+    vector<BudgetAlert> alerts;          // спрацювання, ще не забрані takeBudgetAlerts
+    atomic<bool> alertsPending{ false }; // швидка перевірка без блокування
+
+    static constexpr size_t MaxPendingAlerts = 1024;
+
+    // Будує календарні ряди з усіх живих рядків (mutex захоплений унікально)
+    void buildRollupsLocked() const {
+        rollups.clear();
+        for (size_t i = 0; i < byDate.size(); ++i) {
+            RowId r = byDate[i];
+            if (expenseFlags[r]) rollups.onInsert(dates[r], walletIds[r], categoryIds[r], amounts[r]);
+        }
+        rollupsReady = true;
+    }
+
+    void ensureRollups() const {
+        {
+            shared_lock<shared_mutex> lock(mutex);
+            if (rollupsReady) return;
+        }
+        unique_lock<shared_mutex> lock(mutex);
+        if (!rollupsReady) buildRollupsLocked();
+    }
+
+    // Нова витрата у календарних рядах і перевірка бюджетів (mutex захоплений унікально).
+    // Бюджети перевіряються лише для операцій, що змінюють баланс (spend), а не для імпорту історії.
+    void onExpenseLocked(time_t date, WalletId w, CategoryId c, Money amt, bool checkBudgets) {
+        if (!rollupsReady) return;
+        rollups.onInsert(date, w, c, amt);
+        if (!checkBudgets) return;
+        for (const Budget& b : budgets) {
+            if ((b.wallet != StringDictionary::npos && b.wallet != w) || (b.category != StringDictionary::npos && b.category != c)) continue;
+            int64_t period = rollups.periodOf(date, b.granularity);
+            Money after = rollups.total(b.granularity, period, b.wallet, b.category).sum;
+            Money before = after - amt;
+            Money warnAt = Money::fromMinor(llround(static_cast<double>(b.limit.minorUnits()) * b.warnRatio));
+            bool exceeded = before < b.limit && after >= b.limit;
+            bool warned = !exceeded && b.warnRatio > 0 && b.warnRatio < 1 && before < warnAt && after >= warnAt;
+            if ((exceeded || warned) && alerts.size() < MaxPendingAlerts) {
+                alerts.push_back(BudgetAlert{ b, period, after, exceeded });
+                alertsPending.store(true, memory_order_release);
+            }
+        }
+    }
+
+    // Реєструє зміну (mutex уже захоплений): присвоює їй наступний номер і дописує у журнал.
+    // Повертає true, якщо пачку журналу пора скинути на диск.
+    bool logLocked(Journal::Record& rec) {
+        rec.lsn = ++lastLsn;
+        return journal && journal->append(rec);
+    }
+
+    // Позиція рядка r у впорядкованому за датою індексі (index.size(), якщо немає)
+    size_t findInIndex(const Column<RowId>& index, RowId r) const {
+        for (size_t i = lowerBoundByDate(index, dates[r]); i < index.size() && dates[index[i]] == dates[r]; ++i)
+            if (index[i] == r) return i;
+        return index.size();
+    }
+
+public:
+    // Категорія поповнень завжди має номер 0
+    static constexpr CategoryId DepositCategory = 0;
+
+    // Рядок для пакетного додавання (імпорт)
+    struct NewRow {
+        WalletId wallet;
+        CategoryId category;
+        Money amount;
+        time_t date;
+        bool expense;
+    };
+
+    TransactionLedger() { categories.intern("Deposit"); }
+    TransactionLedger(const TransactionLedger&) = delete;
+    TransactionLedger& operator=(const TransactionLedger&) = delete;
+
+    // Кількість рядків (усі стовпці до цієї межі записані; можна читати без блокування)
+    size_t size() const { return rowCount.load(memory_order_acquire); }
+
+    // Повертає ідентифікатор категорії (створює нову, якщо такої ще немає)
+    CategoryId categoryId(string_view name) { return categories.intern(name); }
+
+    // Пошук категорії без додавання (StringDictionary::npos, якщо немає)
+    CategoryId findCategory(string_view name) const { return categories.find(name); }
+
+    string_view categoryName(CategoryId id) const { return categories.name(id); }
+    size_t categoryCount() const { return categories.size(); }
+
+    // Реєструє ім'я гаманця, повертає його ідентифікатор
+    WalletId walletId(string_view name) { return walletNames.intern(name); }
+
+    // Пошук гаманця за іменем через хеш-індекс (StringDictionary::npos, якщо немає)
+    WalletId findWallet(string_view name) const { return walletNames.find(name); }
+
+    string_view walletName(WalletId id) const { return walletNames.name(id); }
+
+    // Резервує amt в обсязі записаних сум перед записом рядка; false - обсяг переповнився б,
+    // і операцію треба відхилити (резерв не повертається, навіть якщо рядок потім скасують)
+    bool reserveVolume(Money amt) {
+        int64_t a = amt.minorUnits() < 0 ? -amt.minorUnits() : amt.minorUnits();
+        int64_t v = volume.load(memory_order_relaxed);
+        do {
+            if (a > INT64_MAX - v) return false;
+        } while (!volume.compare_exchange_weak(v, v + a, memory_order_relaxed));
+        return true;
+    }
+
+    // Обсяг записаних сум: межа модуля будь-якого балансу чи суми рядків
+    Money recordedVolume() const { return Money::fromMinor(volume.load(memory_order_relaxed)); }
+
+    // Додає рядок у кінець усіх стовпців і журналює його (affectsBalance - чи змінила операція баланс).
+    // Суму вже зарезервовано (reserveVolume).
+    // Повертає номер рядка. Пачка журналу скидається на диск уже після зняття блокування.
+    RowId append(WalletId wallet, CategoryId category, Money amt, time_t date, bool expense, bool affectsBalance) {
+        RowId r;
+        bool flush;
+        {
+            unique_lock<shared_mutex> lock(mutex);
+            amounts.push_back(amt);
+            dates.push_back(date);
+            expenseFlags.push_back(expense ? 1 : 0);
+            balanceFlags.push_back(affectsBalance ? 1 : 0);
+            walletIds.push_back(wallet);
+            categoryIds.push_back(category);
+            r = static_cast<RowId>(amounts.size() - 1);
+            rowCount.store(r + size_t(1), memory_order_release);
+            insertByDate(byDate, r);
+            if (expense) {
+                aggregates.onInsert(r, date, category, amt);
+                onExpenseLocked(date, wallet, category, amt, affectsBalance);
+            }
+            Journal::Record rec;
+            rec.type = Journal::RecordType::TRANSACTION;
+            rec.wallet = wallet;
+            rec.amount = amt;
+            rec.date = date;
+            rec.flags = static_cast<uint8_t>((expense ? Journal::FlagExpense : 0)
+                | (affectsBalance ? Journal::FlagAffectsBalance : 0));
+            if (journal) rec.text = categoryName(category); // без журналу запис не будуємо, лише рахуємо зміни
+            flush = logLocked(rec);
+        }
+        if (flush) journal->sync();
+        return r;
+    }
+
+    // Пакетне додавання (суми вже зарезервовано): уся пачка під одним блокуванням, а часовий індекс зливається з нею
+    // за один прохід (замість вставки кожного рядка "заднім числом" окремо).
+    // Повертає номер першого рядка; рядки пачки мають номери first..first+n-1.
+    RowId appendBatch(const vector<NewRow>& batch, bool affectsBalance) {
+        RowId first;
+        bool flush = false;
+        {
+            unique_lock<shared_mutex> lock(mutex);
+            first = static_cast<RowId>(amounts.size());
+            vector<RowId> added;
+            added.reserve(batch.size());
+            Journal::Record rec;
+            rec.type = Journal::RecordType::TRANSACTION;
+            for (const NewRow& n : batch) {
+                amounts.push_back(n.amount);
+                dates.push_back(n.date);
+                expenseFlags.push_back(n.expense ? 1 : 0);
+                balanceFlags.push_back(affectsBalance ? 1 : 0);
+                walletIds.push_back(n.wallet);
+                categoryIds.push_back(n.category);
+                RowId r = static_cast<RowId>(amounts.size() - 1);
+                rowCount.store(r + size_t(1), memory_order_release);
+                added.push_back(r);
+                if (n.expense) {
+                    aggregates.onInsert(r, n.date, n.category, n.amount);
+                    onExpenseLocked(n.date, n.wallet, n.category, n.amount, false);
+                }
+                rec.wallet = n.wallet;
+                rec.amount = n.amount;
+                rec.date = n.date;
+                rec.flags = static_cast<uint8_t>((n.expense ? Journal::FlagExpense : 0)
+                    | (affectsBalance ? Journal::FlagAffectsBalance : 0));
+                if (journal) rec.text = categoryName(n.category);
+                flush |= logLocked(rec);
+            }
+            mergeByDate(byDate, added);
+        }
+        if (flush) journal->sync();
+        return first;
+    }
+
+    // Скасовує рядок: прибирає його з часового індексу, з індексу гаманця та з агрегатів, журналює.
+    // Повертає false, якщо рядка немає у walletRows (вже скасований або чужий).
+    // walletRows захищає блокування гаманця, яке викликач уже тримає.
+    bool remove(RowId r, Column<RowId>& walletRows) {
+        bool flush;
+        {
+            unique_lock<shared_mutex> lock(mutex);
+            size_t pos = findInIndex(walletRows, r);
+            if (pos == walletRows.size()) return false;
+            walletRows.erase(pos);
+            byDate.erase(findInIndex(byDate, r));
+            ++removedCount;
+            if (expenseFlags[r] && rollupsReady) rollups.onRemove(dates[r], walletIds[r], categoryIds[r], amounts[r]);
+            if (expenseFlags[r] && aggregates.onRemove(r, dates[r], categoryIds[r], amounts[r])) {
+                // скасовано одну з найбільших витрат - перебудовуємо купу з живих рядків
+                aggregates.clearTop();
+                for (RowId row : byDate) if (expenseFlags[row]) aggregates.offerTop(amounts[row], row);
+            }
+            Journal::Record rec;
+            rec.type = Journal::RecordType::CANCEL;
+            rec.wallet = walletIds[r];
+            rec.row = r;
+            flush = logLocked(rec);
+        }
+        if (flush) journal->sync();
+        return true;
+    }
+
+    // Журналює зміну, що не є рядком (наприклад, новий гаманець)
+    void log(Journal::Record&& rec) {
+        bool flush;
+        {
+            unique_lock<shared_mutex> lock(mutex);
+            flush = logLocked(rec);
+        }
+        if (flush) journal->sync();
+    }
+
+    // Найбільші витрати за весь час з купи агрегатів (до ExpenseAggregates::TopCapacity)
+    vector<RowId> topExpenseRows(size_t n) const {
+        shared_lock<shared_mutex> lock(mutex);
+        return aggregates.topRows(n);
+    }
+
+    // Підключає (або відключає - nullptr) журнал операцій
+    void attachJournal(Journal* j) {
+        unique_lock<shared_mutex> lock(mutex);
+        journal = j;
+    }
+
+    // Номер останньої зміни; записи журналу з меншим або рівним номером уже є у стані
+    uint64_t getLastLsn() const {
+        shared_lock<shared_mutex> lock(mutex);
+        return lastLsn;
+    }
+    void setLastLsn(uint64_t lsn) {
+        unique_lock<shared_mutex> lock(mutex);
+        lastLsn = lsn;
+    }
+
+    // Вставляє рядок у впорядкований за датою індекс.
+    // Звичайний випадок (нова операція) - просто додавання в кінець;
+    // "заднім числом" - вставка після останнього рядка з такою ж або ранішою датою.
+    // Індекс має бути захищений блокуванням свого власника.
+    void insertByDate(Column<RowId>& index, RowId r) const {
+        time_t d = dates[r];
+        if (index.empty() || dates[index.back()] <= d) { index.push_back(r); return; }
+        auto pos = upper_bound(index.begin(), index.end(), d,
+            [this](time_t value, RowId row) { return value < dates[row]; });
+        index.insert(static_cast<size_t>(pos - index.begin()), r);
+    }
+
+    // Додає у впорядкований за датою індекс пачку рядків. Пачка сортується стабільно
+    // (однакові дати лишаються у порядку додавання), далі - дописування в кінець або одне злиття.
+    // Результат такий самий, як insertByDate для кожного рядка по черзі.
+    void mergeByDate(Column<RowId>& index, vector<RowId>& added) const {
+        if (added.empty()) return;
+        auto earlier = [this](RowId a, RowId b) { return dates[a] < dates[b]; };
+        if (!is_sorted(added.begin(), added.end(), earlier)) stable_sort(added.begin(), added.end(), earlier);
+        if (index.empty() || dates[index.back()] <= dates[added.front()]) {
+            index.append(added.data(), added.size());
+            return;
+        }
+        vector<RowId> merged;
+        merged.reserve(index.size() + added.size());
+        merge(index.begin(), index.end(), added.begin(), added.end(), back_inserter(merged), earlier);
+        index.assign(move(merged));
+    }
+
+    // Перша позиція у впорядкованому індексі з датою >= start (бінарний пошук)
+    size_t lowerBoundByDate(const Column<RowId>& index, time_t start) const {
+        auto pos = lower_bound(index.begin(), index.end(), start,
+            [this](RowId row, time_t value) { return dates[row] < value; });
+        return static_cast<size_t>(pos - index.begin());
+    }
+
+    // Позиція рядка r у впорядкованому індексі (для курсорів)
+    IndexPosition positionOf(RowId r) const { return IndexPosition{ dates[r], r, true }; }
+
+    // Копіює в out до max рядків впорядкованого індексу, що йдуть після позиції pos
+    // (або починаючи з дати start, якщо прохід ще не почався) і не далі за позицію end (якщо задана).
+    // Індекс захищає його власник.
+    size_t copyAfter(const Column<RowId>& index, const IndexPosition& pos, time_t start, RowId* out, size_t max,
+        const IndexPosition* end = nullptr) const {
+        size_t i;
+        if (!pos.started) i = start == 0 ? 0 : lowerBoundByDate(index, start);
+        else {
+            i = lowerBoundByDate(index, pos.date);
+            while (i < index.size() && dates[index[i]] == pos.date && index[i] <= pos.row) ++i;
+        }
+        size_t n = 0;
+        for (; i < index.size() && n < max; ++i) {
+            RowId r = index[i];
+            if (end && (dates[r] > end->date || (dates[r] == end->date && r > end->row))) break;
+            out[n++] = r;
+        }
+        return n;
+    }
+
+    // Наступна пачка часового індексу після позиції pos (для курсорів і паралельних проходів)
+    size_t rowsAfter(const IndexPosition& pos, time_t start, RowId* out, size_t max, const IndexPosition* end = nullptr) const {
+        shared_lock<shared_mutex> lock(mutex);
+        return copyAfter(byDate, pos, start, out, max, end);
+    }
+
+    // Викликає f(row) для кожного рядка з датою >= start (під shared-блокуванням;
+    // f не повинна змінювати сховище). Для всього часу (і без скасованих рядків)
+    // йдемо по стовпцях послідовно, інакше - по відрізку часового індексу: O(log n + k)
+    template <class F>
+    void forEachRowSince(time_t start, F&& f) const {
+        shared_lock<shared_mutex> lock(mutex);
+        if (start == 0 && removedCount == 0) {
+            size_t n = size();
+            for (size_t r = 0; r < n; ++r) f(static_cast<RowId>(r));
+            return;
+        }
+        for (size_t i = lowerBoundByDate(byDate, start); i < byDate.size(); ++i) f(byDate[i]);
+    }
+
+    // Суми витрат по категоріях для дат >= start з готових агрегатів:
+    // повні доби беремо з добових кошиків, а неповну першу добу дораховуємо за часовим індексом.
+    vector<ExpenseAggregates::Bucket> categorySumsSince(time_t start) const {
+        shared_lock<shared_mutex> lock(mutex);
+        if (start == 0) return aggregates.allTime();
+        const int64_t secondsPerDay = 24 * 60 * 60;
+        int64_t firstDay = dayOf(start);
+        if (static_cast<int64_t>(start) != firstDay * secondsPerDay) ++firstDay; // перша доба неповна
+        vector<ExpenseAggregates::Bucket> sums;
+        aggregates.addDaysFrom(firstDay, sums);
+        time_t boundary = static_cast<time_t>(firstDay * secondsPerDay);
+        for (size_t i = lowerBoundByDate(byDate, start); i < byDate.size() && dates[byDate[i]] < boundary; ++i) {
+            RowId r = byDate[i];
+            if (!expenseFlags[r]) continue;
+            if (sums.size() <= categoryIds[r]) sums.resize(categoryIds[r] + 1);
+            sums[categoryIds[r]].sum += amounts[r];
+            ++sums[categoryIds[r]].count;
+        }
+        return sums;
+    }
+
+    // Календарний ряд витрат за періоди [first, last] для гаманця/категорії (npos - усі)
+    vector<SeriesPoint> spendingSeries(SeriesGranularity g, int64_t first, int64_t last, WalletId w, CategoryId c) const {
+        ensureRollups();
+        shared_lock<shared_mutex> lock(mutex);
+        return rollups.series(g, first, last, w, c);
+    }
+
+    // Додає бюджет і журналює його (бюджети зберігаються у знімку разом зі сховищем); повертає його номер
+    size_t addBudget(const Budget& b) {
+        ensureRollups();
+        size_t id;
+        bool flush;
+        {
+            unique_lock<shared_mutex> lock(mutex);
+            budgets.push_back(b);
+            id = budgets.size() - 1;
+            Journal::Record rec;
+            rec.type = Journal::RecordType::BUDGET;
+            rec.wallet = b.wallet;
+            rec.amount = b.limit;
+            rec.date = static_cast<time_t>(llround(b.warnRatio * 1e6));
+            rec.flags = static_cast<uint8_t>(b.granularity);
+            if (b.category != StringDictionary::npos) rec.text = categoryName(b.category);
+            flush = logLocked(rec);
+        }
+        if (flush) journal->sync();
+        return id;
+    }
+
+    // Забирає накопичені спрацювання бюджетів (без блокування, якщо їх немає)
+    vector<BudgetAlert> takeBudgetAlerts() {
+        vector<BudgetAlert> taken;
+        if (!alertsPending.load(memory_order_acquire)) return taken;
+        unique_lock<shared_mutex> lock(mutex);
+        taken.swap(alerts);
+        alertsPending.store(false, memory_order_relaxed);
+        return taken;
+    }
+
+    // Кількість живих (не скасованих) рядків
+    size_t liveRows() const {
+        shared_lock<shared_mutex> lock(mutex);
+        return size() - removedCount;
+    }
+
+    // Якщо жоден рядок не скасовано, записує у n кількість рядків (усі 0..n-1 живі) і повертає true.
+    // Обидві умови читаються під одним блокуванням, тож n узгоджене зі станом скасувань.
+    bool liveRowsDense(size_t& n) const {
+        shared_lock<shared_mutex> lock(mutex);
+        n = size();
+        return removedCount == 0;
+    }
+
+    // Доступ до окремих значень рядка (без блокування: записані рядки незмінні)
+    Money amountAt(RowId r) const { return amounts[r]; }
+    time_t dateAt(RowId r) const { return dates[r]; }
+    bool isExpenseAt(RowId r) const { return expenseFlags[r] != 0; }
+    bool affectsBalanceAt(RowId r) const { return balanceFlags[r] != 0; }
+    WalletId walletAt(RowId r) const { return walletIds[r]; }
+    CategoryId categoryAt(RowId r) const { return categoryIds[r]; }
+
+    // Доступ до цілих стовпців (для потокового проходу)
+    const ChunkedColumn<Money>& amountColumn() const { return amounts; }
+    const ChunkedColumn<time_t>& dateColumn() const { return dates; }
+    const ChunkedColumn<uint8_t>& expenseColumn() const { return expenseFlags; }
+    const ChunkedColumn<WalletId>& walletColumn() const { return walletIds; }
+    const ChunkedColumn<CategoryId>& categoryColumn() const { return categoryIds; }
+
+    // Викликає f(amounts, expense, wallets, categories, n) для неперервних відрізків рядків [from, to)
+    // (для ядер підсумовування). Рядки мають бути вже опубліковані (from, to <= size()).
+    template <class F>
+    void forEachSpan(size_t from, size_t to, F&& f) const {
+        while (from < to) {
+            size_t n1, n2, n3, n4;
+            const Money* a = amounts.span(from, to, n1);
+            const uint8_t* e = expenseFlags.span(from, to, n2);
+            const WalletId* w = walletIds.span(from, to, n3);
+            const CategoryId* c = categoryIds.span(from, to, n4);
+            size_t n = min(min(n1, n2), min(n3, n4));
+            f(a, e, w, c, n);
+            from += n;
+        }
+    }
+
+    // Запис словників, агрегатів і стовпців у бінарний файл.
+    // Викликач не допускає нових записів (тримає блокування всіх гаманців).
+    void save(BinaryWriter& w) const {
+        shared_lock<shared_mutex> lock(mutex);
+        size_t n = size();
+        w.value(lastLsn);
+        w.value(static_cast<uint64_t>(removedCount));
+        w.value(static_cast<uint32_t>(categories.size()));
+        for (size_t i = 0; i < categories.size(); ++i) w.str(categories.name(static_cast<uint32_t>(i)));
+        aggregates.save(w);
+        w.column(amounts, n);
+        w.column(dates, n);
+        w.column(expenseFlags, n);
+        w.column(walletIds, n);
+        w.column(categoryIds, n);
+        w.column(balanceFlags, n);
+        w.column(byDate);
+        w.value(static_cast<uint32_t>(budgets.size()));
+        for (const Budget& b : budgets) {
+            w.value(b.wallet);
+            w.value(b.category);
+            w.value(static_cast<uint8_t>(b.granularity));
+            w.value(b.limit);
+            w.value(b.warnRatio);
+        }
+    }
+
+    // Чи є index коректним впорядкованим індексом рядків: кожен номер < size(), пари (дата, номер)
+    // строго зростають (отже, без повторів), а якщо wallet != npos - усі рядки цього гаманця.
+    // Викликається при завантаженні, до того як індекс стане доступним іншим потокам.
+    bool validIndex(const Column<RowId>& index, WalletId wallet = StringDictionary::npos) const {
+        size_t n = size();
+        for (size_t i = 0; i < index.size(); ++i) {
+            RowId r = index[i];
+            if (r >= n || (wallet != StringDictionary::npos && walletIds[r] != wallet)) return false;
+            if (i > 0) {
+                RowId p = index[i - 1];
+                if (dates[p] > dates[r] || (dates[p] == dates[r] && p >= r)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Читання з відображеного файлу: словники й агрегати розбираються, стовпці прив'язуються напряму.
+    // Імена гаманців реєструє FinanceManager (вони зберігаються разом із гаманцями).
+    // version - версія формату файлу (номер зміни зберігається починаючи з версії 2,
+    // суми у мінімальних одиницях - з версії 3; старі суми в double перетворюються при читанні;
+    // ознака зміни балансу - з версії 4, у старших файлах кожен рядок вважається таким, що змінив баланс;
+    // бюджети - з версії 5).
+    // Файлу не довіряємо: крім довжин стовпців перевіряються номери гаманців (< walletCount)
+    // і категорій, часовий індекс і агрегати - один послідовний прохід по стовпцях,
+    // щоб пошкоджений файл відхилявся тут, а не читав за межами масивів пізніше.
+    bool load(BinaryReader& r, shared_ptr<const MappedFile> file, uint32_t version, size_t walletCount) {
+        unique_lock<shared_mutex> lock(mutex);
+        mapping = move(file);
+        categories.clear();
+        walletNames.clear();
+        lastLsn = version >= 2 ? r.value<uint64_t>() : 0;
+        removedCount = static_cast<size_t>(r.value<uint64_t>());
+        uint32_t categoryCount = r.count<uint32_t>(sizeof(uint32_t));
+        for (uint32_t i = 0; i < categoryCount && r.ok(); ++i) categories.intern(r.view());
+        if (categories.size() != categoryCount) return false; // повтори зсунули б номери категорій
+        aggregates.load(r, version < 3);
+        if (version >= 3) r.column(amounts);
+        else {
+            Column<double> legacy;
+            r.column(legacy);
+            amounts.clear();
+            for (double v : legacy) amounts.push_back(Money::fromDouble(v));
+        }
+        r.column(dates);
+        r.column(expenseFlags);
+        r.column(walletIds);
+        r.column(categoryIds);
+        size_t n = amounts.size();
+        if (version >= 4) r.column(balanceFlags);
+        else {
+            balanceFlags.clear();
+            for (size_t i = 0; i < n; ++i) balanceFlags.push_back(1);
+        }
+        r.column(byDate);
+        if (!r.ok() || categories.size() == 0 || dates.size() != n || expenseFlags.size() != n
+            || walletIds.size() != n || categoryIds.size() != n || balanceFlags.size() != n
+            || removedCount > n || byDate.size() + removedCount != n)
+            return false;
+        rowCount.store(n, memory_order_release);
+        size_t categoryTotal = categories.size();
+        bool idsOk = true;
+        Money total;
+        forEachSpan(0, n, [&](const Money* a, const uint8_t* e, const WalletId* w, const CategoryId* c, size_t k) {
+            for (size_t i = 0; i < k; ++i) {
+                idsOk &= (w[i] < walletCount) & (c[i] < categoryTotal) & (e[i] <= 1);
+                idsOk = idsOk && a[i] > Money::fromMinor(INT64_MIN) && Money::add(total, a[i] < Money() ? -a[i] : a[i], total);
+            }
+            });
+        volume.store(total.minorUnits(), memory_order_relaxed);
+        balanceFlags.forEachSegment(0, n, [&](const uint8_t* f, size_t k) {
+            for (size_t i = 0; i < k; ++i) idsOk &= f[i] <= 1;
+            });
+        budgets.clear();
+        if (version >= 5) {
+            const size_t budgetBytes = 2 * sizeof(uint32_t) + 1 + sizeof(Money) + sizeof(double);
+            budgets.resize(r.count<uint32_t>(budgetBytes));
+            for (Budget& b : budgets) {
+                b.wallet = r.value<WalletId>();
+                b.category = r.value<CategoryId>();
+                b.granularity = static_cast<SeriesGranularity>(r.value<uint8_t>());
+                b.limit = r.value<Money>();
+                b.warnRatio = r.value<double>();
+                idsOk &= b.valid() && (b.wallet == StringDictionary::npos || b.wallet < walletCount)
+                    && (b.category == StringDictionary::npos || b.category < categoryTotal);
+            }
+        }
+        if (!r.ok() || !idsOk || !validIndex(byDate) || !aggregates.valid(n, categoryTotal, total)) return false;
+        if (!budgets.empty()) buildRollupsLocked(); // бюджети перевіряються по рядах
+        return true;
+    }
+};
+
+// Легкий "вид" на один рядок сховища: лише вказівник і номер рядка, без копій рядків
+class TransactionView {
+private:
+    const TransactionLedger* ledger;
+    RowId r;
+
+public:
+    TransactionView(const TransactionLedger& l, RowId row) : ledger(&l), r(row) {}
+
+    RowId row() const { return r; }
+    Money amount() const { return ledger->amountAt(r); }
+    time_t date() const { return ledger->dateAt(r); }
+    bool isExpense() const { return ledger->isExpenseAt(r); }
+    WalletId wallet() const { return ledger->walletAt(r); }
+    CategoryId category() const { return ledger->categoryAt(r); }
+    string_view walletName() const { return ledger->walletName(ledger->walletAt(r)); }
+    string_view categoryName() const { return ledger->categoryName(ledger->categoryAt(r)); }
+};
+
+// Вид операцій для фільтра
+enum class TransactionKind { ANY, EXPENSE, DEPOSIT };
+
+// Фільтр для запитів TOP-N: період, гаманець, категорія, вид операції
+struct TransactionFilter {
+    int days = 0;                                  // останні N днів (0 = весь час)
+    WalletId wallet = StringDictionary::npos;      // конкретний гаманець (npos = усі)
+    CategoryId category = StringDictionary::npos;  // конкретна категорія (npos = усі)
+    TransactionKind kind = TransactionKind::ANY;   // витрати, поповнення або все
+
+    // Чи підходить рядок під фільтр (період перевіряється окремо, через часовий індекс)
+    bool matches(const TransactionLedger& l, RowId r) const {
+        if (wallet != StringDictionary::npos && l.walletAt(r) != wallet) return false;
+        if (category != StringDictionary::npos && l.categoryAt(r) != category) return false;
+        if (kind == TransactionKind::EXPENSE && !l.isExpenseAt(r)) return false;
+        if (kind == TransactionKind::DEPOSIT && l.isExpenseAt(r)) return false;
+        return true;
+    }
+};
+
+// Сума по одній категорії (результат TOP категорій)
+struct CategoryTotal {
+    CategoryId category;
+    Money sum;
+};
+
+// Клас гаманець/картка
+// Сам гаманець не зберігає транзакцій: він є "видом" на рядки спільного TransactionLedger.
+// Кожен гаманець має власний м'ютекс: перевірка ліміту і зміна балансу атомарні,
+// а скидання журналу на диск одним гаманцем не затримує інші. Сама вставка рядка
+// проходить через спільне блокування TransactionLedger.
+class Wallet {
+private:
+    string name;                  // назва гаманця (наприклад "Cash" або "VISA")
+    WalletType type;              // тип: дебетовий чи кредитний
+    atomic<Money> balance;        // поточний баланс (змінюється під mtx, читається без блокування)
+    Money creditLimit;            // кредитний ліміт (для кредитних карт)
+    WalletId id;                  // номер гаманця у FinanceManager
+    TransactionLedger* ledger;    // спільне сховище транзакцій
+    Column<RowId> rows;           // номери рядків цього гаманця у ledger (впорядковані за датою)
+    mutable mutex mtx;            // захищає balance (перевірка + зміна) і rows
+
+    friend class FinanceManager;  // відновлення стану з бінарного файлу, знімки під блокуванням
+
+    // Записує рядок у спільне сховище і запам'ятовує його номер (mtx уже захоплений)
+    void record(CategoryId category, Money amt, bool expense, time_t date, bool affectsBalance) {
+        RowId r = ledger->append(id, category, amt, date, expense, affectsBalance);
+        ledger->insertByDate(rows, r);
+    }
+
+    // Змінює баланс (mtx уже захоплений)
+    void addToBalance(Money delta) { balance.store(balance.load(memory_order_relaxed) + delta, memory_order_relaxed); }
+
+    // Чи вистачає коштів/ліміту, щоб списати amt (mtx уже захоплений)
+    bool canSpend(Money amt) const {
+        Money current = getBalance();
+        if (type == WalletType::DEBIT) return amt <= current; // для дебетових карт - лише наявні кошти
+        Money after;                                          // для кредитних - з урахуванням ліміту
+        return Money::subtract(current, amt, after) && after >= -creditLimit;
+    }
+
+public:
+    // Конструктор
+    Wallet(TransactionLedger& l, WalletId wid, const string& n, WalletType t, Money creditLim = Money())
+        : name(n), type(t), balance(Money()), creditLimit(creditLim), id(wid), ledger(&l) {
+    }
+
+    // Гетери (повертають значення полів)
+    const string& getName() const { return name; }
+    WalletType getType() const { return type; }
+    Money getBalance() const { return balance.load(memory_order_relaxed); }
+    Money getCreditLimit() const { return creditLimit; }
+    WalletId getId() const { return id; }
+
+    // Номери рядків цього гаманця у спільному сховищі, впорядковані за датою (тільки читання).
+    // Без блокування: лише коли з цим гаманцем паралельно ніхто не працює; інакше - rowsAfter().
+    const Column<RowId>& getRows() const { return rows; }
+
+    // Баланс і позиція останнього рядка гаманця в один момент (для звіту, узгодженого з балансом).
+    // false - рядків з датою >= start немає
+    bool lastRowSince(time_t start, Money& balanceOut, IndexPosition& last) const {
+        lock_guard<mutex> lock(mtx);
+        balanceOut = getBalance();
+        if (rows.empty() || ledger->dateAt(rows.back()) < start) return false;
+        last = ledger->positionOf(rows.back());
+        return true;
+    }
+
+    // Наступна пачка рядків гаманця після позиції pos, не далі за end (для курсорів і звітів)
+    size_t rowsAfter(const IndexPosition& pos, time_t start, RowId* out, size_t max, const IndexPosition* end = nullptr) const {
+        lock_guard<mutex> lock(mtx);
+        return ledger->copyAfter(rows, pos, start, out, max, end);
+    }
+
+    // Додає транзакцію з довільною датою без зміни балансу (наприклад, історичні дані).
+    // false - сума не додатна або переповнила б суми сховища
+    bool addTransaction(const string& category, Money amt, bool expense, time_t date) {
+        if (amt <= Money() || !ledger->reserveVolume(amt)) return false;
+        CategoryId c = ledger->categoryId(category);
+        lock_guard<mutex> lock(mtx);
+        record(c, amt, expense, date, false);
+        return true;
+    }
+
+    // Відтворення операції з журналу: перевірки вже виконані при першому записі
+    // (false - сума не вміщується в сховище, тобто журнал не від цього знімка)
+    bool replay(const Journal::Record& rec) {
+        bool expense = (rec.flags & Journal::FlagExpense) != 0;
+        bool affectsBalance = (rec.flags & Journal::FlagAffectsBalance) != 0;
+        if (!ledger->reserveVolume(rec.amount)) return false;
+        CategoryId c = ledger->categoryId(rec.text);
+        lock_guard<mutex> lock(mtx);
+        if (affectsBalance) addToBalance(expense ? -rec.amount : rec.amount);
+        record(c, rec.amount, expense, rec.date, affectsBalance);
+        return true;
+    }
+
+    // Скасування транзакції цього гаманця: повертає її вплив на баланс (лише якщо операція його змінила,
+    // історичні записи addTransaction баланс не чіпають) і прибирає з індексів та агрегатів.
+    // Не скасовує, якщо рядок не належить гаманцю або повернення поповнення порушить ліміт.
+    bool cancelTransaction(RowId r) {
+        if (r >= ledger->size() || ledger->walletAt(r) != id) return false;
+        Money delta;
+        if (ledger->affectsBalanceAt(r)) delta = ledger->isExpenseAt(r) ? ledger->amountAt(r) : -ledger->amountAt(r);
+        Money floor = (type == WalletType::DEBIT) ? Money() : -creditLimit;
+        lock_guard<mutex> lock(mtx);
+        if (delta < Money() && getBalance() + delta < floor) return false;
+        if (!ledger->remove(r, rows)) return false;
+        addToBalance(delta);
+        return true;
+    }
+
+    // Поповнення гаманця; false - сума не додатна або переповнила б баланси і суми сховища
+    bool deposit(Money amt) {
+        FINANCE_METRIC_SAMPLED_TIMER(deposit);
+        if (amt <= Money() || !ledger->reserveVolume(amt)) return false; // захист від від’ємних і завеликих сум
+        FINANCE_METRIC_ADD(deposits, 1);
+        lock_guard<mutex> lock(mtx);
+        addToBalance(amt);    // збільшуємо баланс
+        // додаємо транзакцію типу "Deposit"
+        record(TransactionLedger::DepositCategory, amt, false, time(nullptr), true);
+        return true;
+    }
+
+    // Витрата грошей (перевірка коштів/ліміту і списання виконуються атомарно під блокуванням гаманця);
+    // false - недостатньо коштів або ліміту, чи сума не вміщується (переповнила б суми сховища)
+    bool spend(Money amt, string_view category) {
+        FINANCE_METRIC_SAMPLED_TIMER(spend);
+        if (amt <= Money()) { FINANCE_METRIC_ADD(spendInvalid, 1); return false; }
+        CategoryId c = ledger->categoryId(category);
+        lock_guard<mutex> lock(mtx);
+        if (!canSpend(amt)) { // недостатньо коштів або перевищено ліміт
+            if (type == WalletType::CREDIT) FINANCE_METRIC_ADD(spendCreditLimit, 1);
+            else FINANCE_METRIC_ADD(spendInsufficientFunds, 1);
+            return false;
+        }
+        if (!ledger->reserveVolume(amt)) { FINANCE_METRIC_ADD(spendInvalid, 1); return false; } // переповнила б суми
+        addToBalance(-amt);               // знімаємо
+        record(c, amt, true, time(nullptr), true);
+        FINANCE_METRIC_ADD(spendOk, 1);
+        return true;
+    }
+};
+
+// Курсор по рядках, що проходять фільтр, у порядку дат - без копії всієї вибірки.
+// Рядки беруться пачками по BatchRows з індексу гаманця (або загального часового індексу)
+// під коротким блокуванням; між пачками запам'ятовується лише позиція, тож пам'ять O(1),
+// а запис у гаманці паралельно з проходом не блокується.
+class TransactionCursor {
+public:
+    static constexpr size_t BatchRows = 4096;
+
+private:
+    const TransactionLedger* ledger;
+    const Wallet* wallet;         // nullptr - усі гаманці (загальний індекс)
+    TransactionFilter filter;
+    time_t start;
+    IndexPosition position;
+    RowId batch[BatchRows];
+    size_t count = 0, offset = 0;
+    bool finished = false;
+
+    bool fetch() {
+        count = wallet ? wallet->rowsAfter(position, start, batch, BatchRows)
+                       : ledger->rowsAfter(position, start, batch, BatchRows);
+        offset = 0;
+        if (count == 0) { finished = true; return false; }
+        position.started = true;
+        position.row = batch[count - 1];
+        position.date = ledger->dateAt(position.row);
+        return true;
+    }
+
+public:
+    // start - початок періоду (0 - весь час); wallet - індекс, по якому йти (nullptr - загальний)
+    TransactionCursor(const TransactionLedger& l, const Wallet* w, const TransactionFilter& f, time_t from)
+        : ledger(&l), wallet(w), filter(f), start(from) {
+    }
+
+    // Наступний рядок, що проходить фільтр; false - кінець
+    bool next(RowId& r) {
+        while (!finished) {
+            while (offset < count) {
+                RowId row = batch[offset++];
+                if (filter.matches(*ledger, row)) { r = row; return true; }
+            }
+            fetch();
+        }
+        return false;
+    }
+};
+
+// Формат експорту транзакцій
+enum class ExportFormat { TEXT, CSV, JSONL };
+
+// Потокове читання CSV великими шматками (ChunkBytes за раз).
+// Рядки віддаються прямо з буфера, поля - як string_view без std::string на кожне поле.
+// Рядок дійсний до наступного виклику nextLine; поля у лапках не можуть містити переводів рядка.
+class CsvReader {
+private:
+    FILE* file = nullptr;
+    bool ownsFile = true;       // false - чужий потік (stdin), не закриваємо
+    vector<char> buf;
+    size_t begin = 0, end = 0;  // непрочитана частина буфера
+    bool eof = false;
+    size_t lineNo = 0;
+
+public:
+    static constexpr size_t ChunkBytes = 4 << 20;
+
+    explicit CsvReader(const string& path) : file(fopen(path.c_str(), "rb")), buf(ChunkBytes) {}
+    explicit CsvReader(FILE* stream) : file(stream), ownsFile(false), buf(ChunkBytes) {}
+    ~CsvReader() { if (file && ownsFile) fclose(file); }
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+    bool ok() const { return file != nullptr; }
+    size_t lineNumber() const { return lineNo; }
+
+    // Наступний рядок без \r\n; false - кінець файлу
+    bool nextLine(char*& line, size_t& len) {
+        for (;;) {
+            char* from = buf.data() + begin;
+            char* nl = static_cast<char*>(memchr(from, '\n', end - begin));
+            if (nl || (eof && begin < end)) {
+                char* stop = nl ? nl : buf.data() + end;
+                begin = nl ? static_cast<size_t>(nl - buf.data()) + 1 : end;
+                if (stop > from && stop[-1] == '\r') --stop;
+                line = from;
+                len = static_cast<size_t>(stop - from);
+                ++lineNo;
+                return true;
+            }
+            if (eof) return false;
+            // переносимо неповний рядок на початок і дочитуємо наступний шматок
+            memmove(buf.data(), from, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == buf.size()) buf.resize(buf.size() * 2); // рядок довший за буфер
+            size_t n = fread(buf.data() + end, 1, buf.size() - end, file);
+            end += n;
+            if (n == 0) eof = true;
+        }
+    }
+
+    // Розбиває рядок на поля за роздільником (поля у лапках "..." з подвоєними "" всередині
+    // розкодовуються на місці). Пробіли навколо полів відкидаються. Повертає кількість полів
+    // (може бути більшою за maxFields - тоді зайві поля не зберігаються).
+    static size_t split(char* p, size_t len, char delim, string_view* fields, size_t maxFields) {
+        char* e = p + len;
+        size_t n = 0;
+        for (;;) {
+            while (p < e && *p == ' ') ++p;
+            char* start = p;
+            char* stop;
+            if (p < e && *p == '"') {
+                char* out = start;
+                for (++p; p < e; ++p) {
+                    if (*p == '"') {
+                        if (p + 1 < e && p[1] == '"') ++p;
+                        else { ++p; break; }
+                    }
+                    *out++ = *p;
+                }
+                stop = out;
+                while (p < e && *p != delim) ++p;
+            }
+            else {
+                while (p < e && *p != delim) ++p;
+                stop = p;
+                while (stop > start && stop[-1] == ' ') --stop;
+            }
+            if (n < maxFields) fields[n] = string_view(start, static_cast<size_t>(stop - start));
+            ++n;
+            if (p >= e) return n;
+            ++p; // роздільник
+        }
+    }
+};
+
+// Розбір дати з виписки у місцевий час: "YYYY-MM-DD[ HH:MM[:SS]]" (також з 'T') або "DD.MM.YYYY[ HH:MM[:SS]]".
+// mktime викликається лише коли змінюється година (виписки зазвичай впорядковані за часом),
+// решта - проста арифметика. Кешується саме година, бо переходи літнього часу бувають лише на межі години.
+class StatementDateParser {
+private:
+    int64_t cachedKey = -1;
+    time_t cachedHour = 0;
+
+    static bool digits(const char*& p, const char* e, int count, int& v) {
+        v = 0;
+        for (int i = 0; i < count; ++i, ++p) {
+            if (p >= e || *p < '0' || *p > '9') return false;
+            v = v * 10 + (*p - '0');
+        }
+        return true;
+    }
+
+    static bool expect(const char*& p, const char* e, char ch) {
+        if (p >= e || *p != ch) return false;
+        ++p;
+        return true;
+    }
+
+    static int daysInMonth(int y, int m) {
+        static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+        return (m == 2 && leap) ? 29 : days[m - 1];
+    }
+
+public:
+    bool parse(string_view s, time_t& out) {
+        const char* p = s.data();
+        const char* e = p + s.size();
+        int y, mo, d, h = 0, mi = 0, sec = 0;
+        if (e - p >= 10 && p[4] == '-') {
+            if (!digits(p, e, 4, y) || !expect(p, e, '-') || !digits(p, e, 2, mo) || !expect(p, e, '-') || !digits(p, e, 2, d)) return false;
+        }
+        else if (e - p >= 10 && p[2] == '.') {
+            if (!digits(p, e, 2, d) || !expect(p, e, '.') || !digits(p, e, 2, mo) || !expect(p, e, '.') || !digits(p, e, 4, y)) return false;
+        }
+        else return false;
+        if (p < e) {
+            if (*p != ' ' && *p != 'T') return false;
+            ++p;
+            if (!digits(p, e, 2, h) || !expect(p, e, ':') || !digits(p, e, 2, mi)) return false;
+            if (p < e && (!expect(p, e, ':') || !digits(p, e, 2, sec))) return false;
+        }
+        if (p != e || y < 1970 || mo < 1 || mo > 12 || d < 1 || d > daysInMonth(y, mo) || h > 23 || mi > 59 || sec > 59) return false;
+        int64_t key = ((static_cast<int64_t>(y) * 16 + mo) * 32 + d) * 24 + h;
+        if (key != cachedKey) {
+            tm t{};
+            t.tm_year = y - 1900;
+            t.tm_mon = mo - 1;
+            t.tm_mday = d;
+            t.tm_hour = h;
+            t.tm_isdst = -1;
+            time_t hour = mktime(&t);
+            if (hour == static_cast<time_t>(-1)) return false;
+            cachedKey = key;
+            cachedHour = hour;
+        }
+        out = cachedHour + mi * 60 + sec;
+        return true;
+    }
+};
+
+// Підсумок імпорту (деталі відхилених рядків - у звіті помилок)
+struct ImportResult {
+    bool opened = false;   // чи вдалося відкрити файл
+    size_t imported = 0;   // додано рядків
+    size_t rejected = 0;   // відхилено рядків
+};
+
+// Форматування дат "YYYY-MM-DD HH:MM" (місцевий час) з кешем на одну годину:
+// localtime/strftime викликаються лише коли змінюється година, хвилини дописуються арифметикою.
+// Рядки звітів ідуть за датою, тож майже всі виклики влучають у кеш.
+class DateFormatter {
+private:
+    time_t hourStart = 0, hourEnd = 0;  // закешована година [hourStart, hourEnd)
+    char prefix[32];                    // "YYYY-MM-DD HH:" для неї
+    size_t prefixLen = 0;
+
+public:
+    static constexpr size_t MaxLength = 37;
+
+    // Записує дату у out (0 - "-"), повертає кількість символів.
+    // withSeconds - "YYYY-MM-DD HH:MM:SS" (для експорту без втрати точності)
+    size_t format(time_t t, char* out, bool withSeconds = false) {
+        if (t == 0) { out[0] = '-'; return 1; }
+        if (prefixLen == 0 || t < hourStart || t >= hourEnd) {
+            tm local_tm;
+#if defined(_MSC_VER)   // для MSVC
+            localtime_s(&local_tm, &t);
+#else                  // для Linux/Mingw
+            localtime_r(&t, &local_tm);
+#endif
+            prefixLen = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:", &local_tm);
+            hourStart = t - local_tm.tm_min * 60 - local_tm.tm_sec;
+            hourEnd = hourStart + 60 * 60;
+        }
+        memcpy(out, prefix, prefixLen);
+        int sinceHour = static_cast<int>(t - hourStart);
+        char* p = out + prefixLen;
+        *p++ = static_cast<char>('0' + sinceHour / 600);
+        *p++ = static_cast<char>('0' + sinceHour / 60 % 10);
+        if (withSeconds) {
+            *p++ = ':';
+            *p++ = static_cast<char>('0' + sinceHour % 60 / 10);
+            *p++ = static_cast<char>('0' + sinceHour % 10);
+        }
+        return static_cast<size_t>(p - out);
+    }
+};
+
+// Буфер звіту: рядки збираються у великий рядок без iostream (числа - to_chars,
+// дати - через DateFormatter) і віддаються у потік одним записом.
+// Буфер можна перевикористовувати: clear() не звільняє пам'ять.
+class ReportBuffer {
+private:
+    string buf;
+    DateFormatter dates;
+#if FINANCE_METRICS
+    size_t countedCapacity = 0;  // місткість буфера на момент останнього запису (для лічильника виділень)
+#endif
+
+public:
+    ReportBuffer& operator<<(string_view s) { buf.append(s.data(), s.size()); return *this; }
+    ReportBuffer& operator<<(char c) { buf.push_back(c); return *this; }
+
+    // Сума з двома знаками після коми
+    ReportBuffer& money(Money v) {
+        char tmp[24];
+        buf.append(tmp, v.format(tmp));
+        return *this;
+    }
+
+    ReportBuffer& number(long long v) {
+        char tmp[24];
+        auto res = to_chars(tmp, tmp + sizeof(tmp), v);
+        buf.append(tmp, static_cast<size_t>(res.ptr - tmp));
+        return *this;
+    }
+
+    ReportBuffer& date(time_t t, bool withSeconds = false) {
+        char tmp[DateFormatter::MaxLength];
+        buf.append(tmp, dates.format(t, tmp, withSeconds));
+        return *this;
+    }
+
+    // Поле CSV: у лапках (з подвоєними "), лише якщо містить роздільник, лапки або перевід рядка
+    ReportBuffer& csvField(string_view s) {
+        if (s.find_first_of(",\"\r\n") == string_view::npos) return *this << s;
+        buf.push_back('"');
+        for (char c : s) {
+            if (c == '"') buf.push_back('"');
+            buf.push_back(c);
+        }
+        buf.push_back('"');
+        return *this;
+    }
+
+    // Рядок JSON у лапках з екрануванням
+    ReportBuffer& jsonString(string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        buf.push_back('"');
+        for (char c : s) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') { buf.push_back('\\'); buf.push_back(c); }
+            else if (c == '\n') buf.append("\\n");
+            else if (c == '\r') buf.append("\\r");
+            else if (c == '\t') buf.append("\\t");
+            else if (u < 0x20) { buf.append("\\u00"); buf.push_back(hex[u >> 4]); buf.push_back(hex[u & 15]); }
+            else buf.push_back(c);
+        }
+        buf.push_back('"');
+        return *this;
+    }
+
+    size_t size() const { return buf.size(); }
+    void clear() { buf.clear(); }
+
+    // Віддає вміст у потік одним записом і очищає буфер
+    void flushTo(ostream& out) {
+#if FINANCE_METRICS
+        if (buf.capacity() > countedCapacity) {
+            financeMetrics.reportAllocations.add();
+            countedCapacity = buf.capacity();
+        }
+        financeMetrics.reportBytes.add(buf.size());
+        financeMetrics.reportFlushes.add();
+#endif
+        out.write(buf.data(), static_cast<streamsize>(buf.size()));
+        buf.clear();
+    }
+};
+
+// Пул потоків для паралельних звітів.
+// run(n, f) виконує f(0..n-1) і чекає завершення; викликач працює разом із потоками пулу.
+// Задачі розкладаються по чергах потоків, а потік, що спорожнив свою чергу, краде задачі
+// з кінця чужих - так великий гаманець не затримує решту потоків.
+class TaskPool {
+private:
+    struct Queue {
+        mutex m;
+        deque<size_t> tasks;
+    };
+
+    vector<thread> threads;
+    vector<unique_ptr<Queue>> queues;  // черга на кожен потік пулу + черга викликача (остання)
+    mutex runMutex;                    // одночасно виконується лише один запуск
+    mutex m;                           // захищає поля нижче
+    condition_variable wake, done;
+    const function<void(size_t)>* job = nullptr;
+    uint64_t generation = 0;           // номер запуску (потоки прокидаються, коли він змінюється)
+    size_t active = 0;                 // потоки пулу, що ще працюють над поточним запуском
+    exception_ptr error;               // перший виняток із задач
+    bool stopping = false;
+
+    // Наступна задача: спочатку зі своєї черги (з початку), потім крадіжка з кінця чужої
+    bool take(size_t self, size_t& task) {
+        for (size_t i = 0; i < queues.size(); ++i) {
+            Queue& q = *queues[(self + i) % queues.size()];
+            lock_guard<mutex> lock(q.m);
+            if (q.tasks.empty()) continue;
+            if (i == 0) { task = q.tasks.front(); q.tasks.pop_front(); }
+            else { task = q.tasks.back(); q.tasks.pop_back(); }
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t self, const function<void(size_t)>& f) {
+        size_t task;
+        while (take(self, task)) {
+            try { f(task); }
+            catch (...) {
+                lock_guard<mutex> lock(m);
+                if (!error) error = current_exception();
+            }
+        }
+    }
+
+    void loop(size_t self) {
+        uint64_t seen = 0;
+        for (;;) {
+            const function<void(size_t)>* f;
+            {
+                unique_lock<mutex> lock(m);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                f = job;
+            }
+            work(self, *f);
+            lock_guard<mutex> lock(m);
+            if (--active == 0) done.notify_all();
+        }
+    }
+
+public:
+    // threadCount - загальна кількість виконавців разом із викликачем
+    explicit TaskPool(size_t threadCount) {
+        if (threadCount == 0) threadCount = 1;
+        for (size_t i = 0; i < threadCount; ++i) queues.push_back(make_unique<Queue>());
+        for (size_t i = 0; i + 1 < threadCount; ++i) threads.emplace_back(&TaskPool::loop, this, i);
+    }
+
+    ~TaskPool() {
+        {
+            lock_guard<mutex> lock(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    size_t size() const { return queues.size(); }
+
+    // Виконує f(i) для i = 0..count-1 (f не повинна сама викликати run)
+    void run(size_t count, const function<void(size_t)>& f) {
+        if (count == 0) return;
+        if (count == 1 || threads.empty()) {
+            for (size_t i = 0; i < count; ++i) f(i);
+            return;
+        }
+        lock_guard<mutex> runLock(runMutex);
+        // сусідні задачі - в одну чергу (вони зазвичай з одного гаманця)
+        size_t perQueue = (count + queues.size() - 1) / queues.size();
+        for (size_t i = 0; i < count; ++i) {
+            Queue& q = *queues[i / perQueue];
+            lock_guard<mutex> lock(q.m);
+            q.tasks.push_back(i);
+        }
+        {
+            lock_guard<mutex> lock(m);
+            job = &f;
+            active = threads.size();
+            error = nullptr;
+            ++generation;
+        }
+        wake.notify_all();
+        work(queues.size() - 1, f);
+        unique_lock<mutex> lock(m);
+        done.wait(lock, [&] { return active == 0; });
+        job = nullptr;
+        if (error) {
+            exception_ptr e = error;
+            error = nullptr;
+            rethrow_exception(e);
+        }
+    }
+};
+
+// Результат операції з гаманцем без виводу в консоль
+enum class WalletOpResult { OK, NOT_FOUND, DECLINED };
+
+// Результат завантаження файлу сховища: відсутній файл - звичайний перший запуск,
+// а відхилений (пошкоджений, новішого формату) не можна перезаписувати
+enum class LedgerLoadResult { LOADED, MISSING, REJECTED };
+
+// Клас для управління всіма гаманцями та звітами
+// Потокобезпечний: операції з гаманцями можна викликати з будь-яких потоків (баланс - під
+// блокуванням гаманця, вставка рядка - під коротким блокуванням сховища),
+// а звіти працюють зі знімками і не зупиняють запис.
+class FinanceManager {
+private:
+    unique_ptr<TransactionLedger> ledger = make_unique<TransactionLedger>(); // спільне стовпцеве сховище транзакцій
+    deque<Wallet> wallets;    // усі гаманці (індекс = WalletId); deque не переміщує елементи, тож Wallet* стабільні
+    mutable shared_mutex walletsMutex; // захищає список гаманців (додавання - unique, пошук/обхід - shared)
+    mutex compactMutex;       // лише одне ущільнення журналу одночасно
+    unique_ptr<TaskPool> pool = make_unique<TaskPool>(thread::hardware_concurrency()); // потоки для звітів
+
+    // Скільки рядків імпорту перевіряється і додається за одне блокування гаманців
+    static constexpr size_t ImportBatchRows = 1 << 16;
+
+    // Чи є поля рядком заголовка імпорту: рівно date, wallet, category, amount (без урахування регістру).
+    // Інший перший рядок - звичайний рядок даних, і якщо він не розбирається, то відхиляється з номером.
+    static bool isImportHeader(const string_view* f, size_t n) {
+        static const string_view names[] = { "date", "wallet", "category", "amount" };
+        if (n != 4) return false;
+        for (size_t i = 0; i < 4; ++i) {
+            if (f[i].size() != names[i].size()) return false;
+            for (size_t k = 0; k < f[i].size(); ++k) {
+                char ch = f[i][k];
+                if (ch >= 'A' && ch <= 'Z') ch = static_cast<char>(ch - 'A' + 'a');
+                if (ch != names[i][k]) return false;
+            }
+        }
+        return true;
+    }
+
+    // Розібраний рядок імпорту (номер рядка файлу - для звіту помилок).
+    // Рядки з помилкою розбору теж ідуть у пачку, щоб звіт помилок був у порядку файлу.
+    struct ImportRow {
+        TransactionLedger::NewRow row;
+        size_t line;
+        string error;   // причина відхилення (порожньо - рядок коректний)
+    };
+
+    // Перевіряє і додає пачку імпорту. Ліміти перевіряються по черзі рядків файлу
+    // (для кожного гаманця - у порядку виписки), усі гаманці заблоковані на час пачки.
+    void commitImport(const vector<ImportRow>& batch, ostream& errors, ImportResult& result) {
+        if (batch.empty()) return;
+        shared_lock<shared_mutex> lock(walletsMutex);
+        auto locks = lockAllWallets();
+        vector<TransactionLedger::NewRow> accepted;
+        accepted.reserve(batch.size());
+        for (const ImportRow& in : batch) {
+            const auto& n = in.row;
+            if (!in.error.empty()) {
+                errors << "line " << in.line << ": " << in.error << "\n";
+                ++result.rejected;
+                continue;
+            }
+            if (n.wallet >= wallets.size()) {
+                errors << "line " << in.line << ": unknown wallet '" << ledger->walletName(n.wallet) << "'\n";
+                ++result.rejected;
+                continue;
+            }
+            Wallet& w = wallets[n.wallet];
+            if (n.expense && !w.canSpend(n.amount)) {
+                errors << "line " << in.line << ": insufficient funds or credit limit in wallet '" << w.getName() << "'\n";
+                ++result.rejected;
+                continue;
+            }
+            if (!ledger->reserveVolume(n.amount)) {
+                errors << "line " << in.line << ": amount too large\n";
+                ++result.rejected;
+                continue;
+            }
+            w.addToBalance(n.expense ? -n.amount : n.amount);
+            accepted.push_back(n);
+        }
+        RowId first = ledger->appendBatch(accepted, true);
+        vector<vector<RowId>> added(wallets.size());
+        for (size_t i = 0; i < accepted.size(); ++i) added[accepted[i].wallet].push_back(first + static_cast<RowId>(i));
+        for (size_t i = 0; i < added.size(); ++i) ledger->mergeByDate(wallets[i].rows, added[i]);
+        result.imported += accepted.size();
+    }
+
+    // Розмір шматка рядків для паралельних звітів. Межі шматків не залежать від кількості потоків,
+    // тому результат (порядок рядків, суми з плаваючою комою) однаковий на будь-якій машині.
+    static constexpr size_t ReportShardRows = 16384;
+
+    // Скільки шматків обробляється за одну хвилю (кілька на потік, щоб вирівняти навантаження).
+    // Паралельні проходи тримають у пам'яті лише одну хвилю номерів рядків, а не всю вибірку.
+    size_t waveShards() const { return pool->size() * 4; }
+
+    // Місткість буфера номерів рядків на хвилю: не більше, ніж рядків у сховищі, щоб малі звіти
+    // не виділяли waveShards() * ReportShardRows номерів. Буфер не обнуляється - курсор однаково
+    // його перезаписує; якщо рядків тим часом додалося, повний буфер означає лише ще одну хвилю.
+    size_t waveRows() const { return max<size_t>(1, min(waveShards() * ReportShardRows, ledger->size())); }
+
+    // Скільки тексту експорту накопичується перед записом у потік
+    static constexpr size_t ExportFlushBytes = 1 << 20;
+
+    unique_ptr<Journal> journal; // журнал операцій (після openJournal)
+    string journalPath;          // файл журналу
+    string snapshotPath;         // файл знімка, у який ущільнюється журнал
+
+    // Розмір журналу, після якого він ущільнюється у знімок
+    static constexpr uint64_t JournalCompactBytes = 64ull << 20;
+
+    // Ущільнення журналу, якщо він виріс понад поріг (викликається з операцій запису)
+    void maybeCompactJournal() {
+        if (journal && journal->size() >= JournalCompactBytes) compactJournal();
+    }
+
+    // Блокує всі гаманці у порядку WalletId (walletsMutex уже захоплений):
+    // поки блокування тримаються, жоден баланс і жоден рядок не змінюються
+    vector<unique_lock<mutex>> lockAllWallets() const {
+        vector<unique_lock<mutex>> locks;
+        locks.reserve(wallets.size());
+        for (const auto& w : wallets) locks.emplace_back(w.mtx);
+        return locks;
+    }
+
+    // Гаманець за номером або nullptr
+    const Wallet* walletById(WalletId id) const {
+        shared_lock<shared_mutex> lock(walletsMutex);
+        return id < wallets.size() ? &wallets[id] : nullptr;
+    }
+
+    // Запис знімка (усі гаманці вже заблоковані). Тимчасовий файл скидається на диск до
+    // перейменування, а каталог - після, тож true означає, що на диску лежить саме новий знімок.
+    bool writeSnapshotLocked(const string& filename) const {
+        FINANCE_METRIC_TIMER(snapshot);
+        const string tmpName = filename + ".tmp";
+        BinaryWriter out(tmpName);
+        if (!out.ok()) { cout << "Failed to open file for writing\n"; return false; }
+        out.bytes(LedgerMagic, sizeof(LedgerMagic));
+        out.value(LedgerVersion);
+        out.value(static_cast<uint32_t>(sizeof(time_t)));
+        out.value(static_cast<uint32_t>(wallets.size()));
+        for (const auto& w : wallets) {
+            out.str(w.name);
+            out.value(static_cast<uint8_t>(w.type == WalletType::CREDIT ? 1 : 0));
+            out.value(w.getBalance());
+            out.value(w.creditLimit);
+        }
+        ledger->save(out);
+        for (const auto& w : wallets) out.column(w.rows);
+        if (!out.close()) { cout << "Failed to write ledger file\n"; return false; }
+#if defined(_WIN32)
+        bool replaced = MoveFileExA(tmpName.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        bool replaced = rename(tmpName.c_str(), filename.c_str()) == 0;
+#endif
+        if (!replaced) { cout << "Failed to replace ledger file\n"; return false; }
+        if (!syncParentDirectory(filename)) { cout << "Failed to sync ledger directory\n"; return false; }
+        return true;
+    }
+
+    // Хвіст рядка звіту: "Wallet: ... | Category: ... | Amount: ... | Date: ...\n"
+    void formatRow(ReportBuffer& out, string_view walletName, RowId r) const {
+        out << "Wallet: " << walletName
+            << " | Category: " << ledger->categoryName(ledger->categoryAt(r))
+            << " | Amount: ";
+        out.money(ledger->amountAt(r)) << " | Date: ";
+        out.date(ledger->dateAt(r)) << '\n';
+    }
+
+    // Звіт по всіх гаманцях у out; повертає, чи була хоч одна транзакція.
+    // Для кожного гаманця баланс і позиція його останнього рядка беруться в один момент, далі
+    // рядки до цієї позиції читаються курсором хвилями по waveShards() шматків по ReportShardRows,
+    // шматки хвилі форматуються паралельно у перевикористовувані буфери і виводяться по порядку -
+    // вивід такий самий, як при послідовному проході, а пам'ять не залежить від розміру звіту.
+    bool writeReport(ostream& out, time_t start) const {
+        FINANCE_METRIC_TIMER(reportWrite);
+        vector<const Wallet*> list;
+        {
+            shared_lock<shared_mutex> lock(walletsMutex);
+            for (const auto& w : wallets) list.push_back(&w);
+        }
+        size_t capacity = waveRows();
+        unique_ptr<RowId[]> batch(new RowId[capacity]);
+        vector<ReportBuffer> text((capacity + ReportShardRows - 1) / ReportShardRows);
+        ReportBuffer head;
+        bool any = false;
+        for (const Wallet* w : list) {
+            Money balance;
+            IndexPosition last;
+            bool hasRows = w->lastRowSince(start, balance, last);
+            head << "\nWallet: " << w->getName()
+                << " | Type: " << (w->getType() == WalletType::DEBIT ? "DEBIT" : "CREDIT")
+                << " | Balance: ";
+            head.money(balance) << '\n';
+            if (!hasRows) head << "  No transactions for the selected period.\n";
+            head.flushTo(out);
+            IndexPosition pos;
+            while (hasRows) {
+                size_t n = w->rowsAfter(pos, start, batch.get(), capacity, &last);
+                if (n == 0) break;
+                any = true;
+                size_t count = (n + ReportShardRows - 1) / ReportShardRows;
+                pool->run(count, [&](size_t i) {
+                    size_t end = min((i + 1) * ReportShardRows, n);
+                    for (size_t k = i * ReportShardRows; k < end; ++k) {
+                        RowId r = batch[k];
+                        text[i] << (ledger->isExpenseAt(r) ? "Expense | " : "Deposit | ");
+                        formatRow(text[i], w->getName(), r);
+                    }
+                    });
+                for (size_t i = 0; i < count; ++i) text[i].flushTo(out);
+                if (n < capacity) break;
+                pos = ledger->positionOf(batch[n - 1]);
+            }
+        }
+        return any;
+    }
+
+    // Нумерований список витрат для ТОП-звітів
+    void writeTopExpenses(ReportBuffer& out, const vector<TransactionView>& top) const {
+        if (top.empty()) out << "No expenses for the period.\n";
+        for (size_t i = 0; i < top.size(); ++i) {
+            out.number(static_cast<long long>(i + 1)) << ". ";
+            formatRow(out, top[i].walletName(), top[i].row());
+        }
+    }
+
+    // Паралельний прохід по рядках, що проходять фільтр. Кандидати - рядки гаманця, відрізок
+    // часового індексу або (весь час без скасованих) просто номери 0..n-1 - обробляються хвилями
+    // по waveShards() шматків: номери рядків хвилі беруться курсором під коротким блокуванням
+    // у перевикористовуваний буфер, без копії всієї вибірки. begin(slots) готує стан на кожне
+    // місце хвилі, f(slot, row) викликається з потоків пулу, а merge(slot) - у викликача після
+    // кожної хвилі, у порядку шматків.
+    template <class Begin, class F, class Merge>
+    void forEachMatchParallel(const TransactionFilter& filter, Begin&& begin, F&& f, Merge&& merge) const {
+        size_t slots = waveShards();
+        begin(slots);
+        time_t start = (filter.days > 0) ? periodStartDays(filter.days) : 0;
+        size_t dense;
+        if (filter.wallet == StringDictionary::npos && start == 0 && ledger->liveRowsDense(dense)) {
+            for (size_t first = 0; first < dense; first += slots * ReportShardRows) {
+                size_t count = min(slots, (dense - first + ReportShardRows - 1) / ReportShardRows);
+                pool->run(count, [&](size_t s) {
+                    size_t from = first + s * ReportShardRows, to = min(from + ReportShardRows, dense);
+                    for (size_t r = from; r < to; ++r)
+                        if (filter.matches(*ledger, static_cast<RowId>(r))) f(s, static_cast<RowId>(r));
+                    });
+                for (size_t s = 0; s < count; ++s) merge(s);
+            }
+            return;
+        }
+        const Wallet* wallet = nullptr;
+        if (filter.wallet != StringDictionary::npos && !(wallet = walletById(filter.wallet))) return;
+        size_t capacity = waveRows();
+        unique_ptr<RowId[]> batch(new RowId[capacity]);
+        IndexPosition pos;
+        for (;;) {
+            size_t n = wallet ? wallet->rowsAfter(pos, start, batch.get(), capacity)
+                              : ledger->rowsAfter(pos, start, batch.get(), capacity);
+            if (n == 0) break;
+            size_t count = (n + ReportShardRows - 1) / ReportShardRows;
+            pool->run(count, [&](size_t s) {
+                size_t end = min((s + 1) * ReportShardRows, n);
+                for (size_t i = s * ReportShardRows; i < end; ++i)
+                    if (filter.matches(*ledger, batch[i])) f(s, batch[i]);
+                });
+            for (size_t s = 0; s < count; ++s) merge(s);
+            if (n < capacity) break;
+            pos = ledger->positionOf(batch[n - 1]);
+        }
+    }
+
+    // Суми витрат по категоріях у рядках 0..n-1 (усі живі) для гаманця/категорії (npos - будь-які).
+    // Стовпці проходяться неперервними відрізками ядрами maskedExpenseSum/expenseSumsByCategory,
+    // шматки - паралельно хвилями, кожне місце хвилі накопичує власні суми. Суми цілі, тож результат
+    // точний і не залежить від кількості потоків.
+    vector<ExpenseAggregates::Bucket> expenseSumsDense(size_t n, WalletId wallet, CategoryId category) const {
+        if (category != StringDictionary::npos && category >= ledger->categoryCount()) return {};
+        size_t shards = (n + ReportShardRows - 1) / ReportShardRows;
+        size_t slots = min(waveShards(), shards);
+        vector<vector<ExpenseAggregates::Bucket>> partial(slots, vector<ExpenseAggregates::Bucket>(ledger->categoryCount()));
+        for (size_t first = 0; first < shards; first += slots) {
+            pool->run(min(slots, shards - first), [&](size_t s) {
+                auto& part = partial[s];
+                size_t from = (first + s) * ReportShardRows;
+                ledger->forEachSpan(from, min(from + ReportShardRows, n),
+                    [&](const Money* a, const uint8_t* e, const WalletId* w, const CategoryId* c, size_t k) {
+                        if (category == StringDictionary::npos) {
+                            expenseSumsByCategory(a, e, w, c, k, wallet, part.data());
+                            return;
+                        }
+                        auto b = maskedExpenseSum(a, e, w, c, k, wallet, category);
+                        part[category].sum += b.sum;
+                        part[category].count += b.count;
+                    });
+                });
+        }
+        vector<ExpenseAggregates::Bucket> sums(ledger->categoryCount());
+        for (const auto& part : partial)
+            for (CategoryId c = 0; c < part.size(); ++c) {
+                sums[c].sum += part[c].sum;
+                sums[c].count += part[c].count;
+            }
+        return sums;
+    }
+
+    // Додає (сума, рядок) в обмежену мін-купу розміру topN
+    static void offerTop(vector<pair<Money, RowId>>& heap, size_t topN, Money amt, RowId r) {
+        auto greater = [](const pair<Money, RowId>& a, const pair<Money, RowId>& b) { return a.first > b.first; };
+        if (heap.size() < topN) {
+            heap.emplace_back(amt, r);
+            push_heap(heap.begin(), heap.end(), greater);
+        }
+        else if (amt > heap.front().first) {
+            pop_heap(heap.begin(), heap.end(), greater);
+            heap.back() = { amt, r };
+            push_heap(heap.begin(), heap.end(), greater);
+        }
+    }
+
+    // Повертає теперішній час
+    static time_t nowTime() {
+        return time(nullptr);
+    }
+
+    // Розрахунок початку періоду (N днів назад)
+    static time_t periodStartDays(int days) {
+        if (days <= 0) return 0;
+        time_t now = nowTime();
+        return now - static_cast<time_t>(days) * 24 * 60 * 60;
+    }
+
+    // Заголовок бінарного файлу сховища
+    static constexpr char LedgerMagic[8] = { 'F', 'M', 'L', 'E', 'D', 'G', 'E', 'R' };
+    static constexpr uint32_t LedgerVersion = 5;
+
+    // Відновлює повну транзакцію з рядка сховища
+    Transaction materialize(RowId r) const {
+        return Transaction(ledger->walletName(ledger->walletAt(r)), ledger->categoryName(ledger->categoryAt(r)),
+            ledger->amountAt(r), ledger->isExpenseAt(r), ledger->dateAt(r));
+    }
+
+public:
+    FinanceManager() = default;
+    // Гаманці тримають вказівник на ledger, тому менеджер не копіюється
+    FinanceManager(const FinanceManager&) = delete;
+    FinanceManager& operator=(const FinanceManager&) = delete;
+
+    // Додає новий гаманець
+    bool addWallet(const string& name, WalletType type, Money creditLimit = Money()) {
+        unique_lock<shared_mutex> lock(walletsMutex);
+        if (ledger->findWallet(name) != StringDictionary::npos) return false; // перевірка на дубль
+        WalletId id = ledger->walletId(name);
+        wallets.emplace_back(*ledger, id, name, type, creditLimit);
+        Journal::Record rec;
+        rec.type = Journal::RecordType::ADD_WALLET;
+        rec.wallet = id;
+        rec.amount = creditLimit;
+        rec.flags = static_cast<uint8_t>(type == WalletType::CREDIT ? 1 : 0);
+        rec.text = name;
+        ledger->log(move(rec));
+        return true;
+    }
+
+    // Повертає вказівник на гаманець за іменем
+    // Вказівник лишається дійсним, поки менеджер існує (гаманці не видаляються і не переміщуються)
+    Wallet* getWallet(string_view name) {
+        shared_lock<shared_mutex> lock(walletsMutex);
+        WalletId id = ledger->findWallet(name);
+        return id == StringDictionary::npos ? nullptr : &wallets[id];
+    }
+
+    // Отримати список усіх гаманців (тільки читання; обхід - лише коли паралельно не додають гаманці)
+    const deque<Wallet>& getAllWallets() const { return wallets; }
+
+    // Кількість гаманців
+    size_t walletCount() const {
+        shared_lock<shared_mutex> lock(walletsMutex);
+        return wallets.size();
+    }
+
+    // Спільне сховище транзакцій (тільки читання)
+    const TransactionLedger& getLedger() const { return *ledger; }
+
+    // Збереження гаманців, балансів, лімітів і всіх транзакцій у бінарний файл.
+    // Пишемо у тимчасовий файл і атомарно підміняємо ним старий: стовпці можуть бути
+    // відображені саме з цього файлу, тому обрізати його на місці не можна.
+    // На час запису всі гаманці заблоковані, тож знімок узгоджений (баланси відповідають рядкам).
+    bool saveLedgerToFile(const string& filename) const {
+        shared_lock<shared_mutex> lock(walletsMutex);
+        auto walletLocks = lockAllWallets();
+        return writeSnapshotLocked(filename);
+    }
+
+    // Завантаження з бінарного файлу: файл відображається у пам'ять, і стовпці
+    // використовуються прямо з відображення, без розбору і копіювання; залишається лише
+    // один послідовний прохід перевірки (близько 50 мс на 3 млн рядків).
+    // Якщо файл відсутній (MISSING) або відхилений (REJECTED, причина - у reason), поточний стан
+    // не змінюється: кожна кількість перевіряється за розміром файлу до виділення пам'яті,
+    // а номери - за межами масивів.
+    // Не можна викликати паралельно з іншими операціями (гаманці створюються заново).
+    LedgerLoadResult loadLedgerFromFile(const string& filename, string* reason = nullptr) {
+        auto reject = [reason](string why) {
+            if (reason) *reason = move(why);
+            return LedgerLoadResult::REJECTED;
+        };
+        error_code ec;
+        if (!filesystem::exists(filename, ec)) return ec ? reject("cannot be read") : LedgerLoadResult::MISSING;
+        auto file = make_shared<MappedFile>();
+        if (!file->open(filename)) return reject("cannot be read or is empty");
+        BinaryReader in(file->data(), file->size());
+        const char* magic = in.bytes(sizeof(LedgerMagic));
+        if (!magic || memcmp(magic, LedgerMagic, sizeof(LedgerMagic)) != 0) return reject("not a ledger file");
+        uint32_t version = in.value<uint32_t>();
+        if (version < 1 || version > LedgerVersion) return reject("unsupported format version " + to_string(version));
+        if (in.value<uint32_t>() != sizeof(time_t)) return reject("written with a different time_t size");
+
+        struct WalletHeader { string name; WalletType type; Money balance; Money creditLimit; };
+        const size_t headerBytes = sizeof(uint32_t) + 1 + 2 * 8; // довжина імені, тип, баланс, ліміт
+        vector<WalletHeader> headers(in.count<uint32_t>(headerBytes));
+        for (auto& h : headers) {
+            h.name = in.str();
+            h.type = in.value<uint8_t>() ? WalletType::CREDIT : WalletType::DEBIT;
+            if (version >= 3) {
+                h.balance = in.value<Money>();
+                h.creditLimit = in.value<Money>();
+            }
+            else {
+                h.balance = Money::fromDouble(in.value<double>());
+                h.creditLimit = Money::fromDouble(in.value<double>());
+            }
+        }
+        auto loaded = make_unique<TransactionLedger>();
+        const char* damaged = "damaged or truncated";
+        if (!in.ok() || !loaded->load(in, file, version, headers.size())) return reject(damaged);
+        vector<Column<RowId>> rows(headers.size());
+        for (auto& c : rows) in.column(c);
+        if (!in.ok()) return reject(damaged);
+        // Номер гаманця - його місце у файлі, тож імена мають бути різні; рядки гаманців разом -
+        // рівно живі рядки сховища (кожен індекс впорядкований і без повторів)
+        size_t liveRows = 0;
+        for (size_t i = 0; i < headers.size(); ++i) {
+            if (loaded->walletId(headers[i].name) != i || !loaded->validIndex(rows[i], static_cast<WalletId>(i))) return reject(damaged);
+            liveRows += rows[i].size();
+        }
+        if (liveRows != loaded->liveRows()) return reject(damaged);
+        // баланси і ліміти - у межах обсягу записаних сум, тож подальші операції з ними не переповнюються
+        Money volume = loaded->recordedVolume();
+        for (const auto& h : headers)
+            if (h.balance < -volume || h.balance > volume || h.creditLimit < Money()) return reject(damaged);
+
+        unique_lock<shared_mutex> lock(walletsMutex);
+        wallets.clear();
+        ledger = move(loaded);
+        ledger->attachJournal(journal.get());
+        for (size_t i = 0; i < headers.size(); ++i) {
+            WalletId id = ledger->walletId(headers[i].name);
+            wallets.emplace_back(*ledger, id, headers[i].name, headers[i].type, headers[i].creditLimit);
+            wallets.back().balance = headers[i].balance;
+            wallets.back().rows = move(rows[i]);
+        }
+        return LedgerLoadResult::LOADED;
+    }
+
+    // Відкриває журнал операцій: спершу відтворює записи, яких ще немає у стані
+    // (новіші за знімок), потім підключає журнал для нових змін.
+    // Викликається на старті, до паралельної роботи.
+    // snapshot - файл, у який журнал ущільнюється (compactJournal).
+    // Запис, який не застосовується до стану (невідомий гаманець, повтор імені, рядок не
+    // скасовується), означає, що журнал не від цього знімка: такі записи не вважаються
+    // застосованими (номер останньої зміни не зсувається), журнал не підключається і
+    // повертається false з причиною у reason - стан не можна зберігати поверх файлів.
+    bool openJournal(const string& path, const string& snapshot, string* reason = nullptr) {
+        journal.reset();
+        ledger->attachJournal(nullptr); // під час відтворення нічого не журналюємо
+        size_t mismatched = 0;
+        uint64_t valid = Journal::replay(path, [this, &mismatched](const Journal::Record& rec) {
+            if (rec.lsn <= ledger->getLastLsn()) return; // уже є у знімку
+            bool applied = false;
+            switch (rec.type) {
+            case Journal::RecordType::ADD_WALLET:
+                applied = addWallet(string(rec.text), rec.flags ? WalletType::CREDIT : WalletType::DEBIT, rec.amount)
+                    && ledger->findWallet(rec.text) == rec.wallet;
+                break;
+            case Journal::RecordType::TRANSACTION:
+                applied = rec.wallet < wallets.size() && wallets[rec.wallet].replay(rec);
+                break;
+            case Journal::RecordType::CANCEL:
+                applied = rec.wallet < wallets.size() && wallets[rec.wallet].cancelTransaction(rec.row);
+                break;
+            case Journal::RecordType::BUDGET: {
+                Budget b;
+                b.wallet = rec.wallet;
+                b.granularity = static_cast<SeriesGranularity>(rec.flags);
+                b.limit = rec.amount;
+                b.warnRatio = static_cast<double>(rec.date) / 1e6;
+                if (!rec.text.empty()) b.category = ledger->findCategory(rec.text);
+                applied = b.valid() && (b.wallet == StringDictionary::npos || b.wallet < wallets.size())
+                    && (rec.text.empty() || b.category != StringDictionary::npos);
+                if (applied) ledger->addBudget(b);
+                break;
+            }
+            }
+            if (applied) ledger->setLastLsn(rec.lsn);
+            else ++mismatched;
+            });
+        if (mismatched) {
+            if (reason) *reason = to_string(mismatched) + " records do not match the ledger file";
+            return false;
+        }
+        auto j = make_unique<Journal>();
+        if (!j->open(path, valid)) {
+            if (reason) *reason = "cannot be opened for writing";
+            return false;
+        }
+        journal = move(j);
+        journalPath = path;
+        snapshotPath = snapshot;
+        ledger->attachJournal(journal.get());
+        return true;
+    }
+
+    // Скидає накопичену пачку журналу на диск; false - запис не вдався. Зміни тоді лишаються
+    // в пам'яті (і у буфері журналу) до наступного успішного скидання або збереження знімка.
+    // Скидання всередині операцій помилку не повертають: їхні пачки теж лишаються в буфері,
+    // і збій видно на найближчому syncJournal().
+    bool syncJournal() {
+        return !journal || journal->sync();
+    }
+
+    // Ущільнення: зберігає повний знімок і очищає журнал.
+    // Усі гаманці заблоковані на обидва кроки, тож між знімком і очищенням не з'явиться нових записів.
+    // Журнал очищається лише після того, як знімок і його перейменування скинуті на диск;
+    // якщо збій станеться раніше, відновлення піде зі старого знімка і повного журналу,
+    // а якщо пізніше - записи журналу не повторяться: їхні номери вже є у знімку.
+    bool compactJournal() {
+        if (!journal) return false;
+        unique_lock<mutex> compactLock(compactMutex, try_to_lock);
+        if (!compactLock.owns_lock()) return false; // уже ущільнює інший потік
+        shared_lock<shared_mutex> lock(walletsMutex);
+        auto walletLocks = lockAllWallets();
+        journal->sync();
+        if (!writeSnapshotLocked(snapshotPath)) return false;
+        return journal->truncate(journalPath);
+    }
+
+    // Поповнення без виводу (пакетний режим); balance - баланс після операції,
+    // DECLINED - сума не додатна або завелика
+    WalletOpResult deposit(string_view name, Money amt, Money* balance = nullptr) {
+        Wallet* w = getWallet(name);
+        if (!w) return WalletOpResult::NOT_FOUND;
+        if (!w->deposit(amt)) return WalletOpResult::DECLINED;
+        maybeCompactJournal();
+        if (balance) *balance = w->getBalance();
+        return WalletOpResult::OK;
+    }
+
+    // Витрата без виводу (пакетний режим); DECLINED - недостатньо коштів або ліміту (чи сума завелика)
+    WalletOpResult spend(string_view name, Money amt, string_view category, Money* balance = nullptr) {
+        Wallet* w = getWallet(name);
+        if (!w) return WalletOpResult::NOT_FOUND;
+        if (!w->spend(amt, category)) return WalletOpResult::DECLINED;
+        maybeCompactJournal();
+        if (balance) *balance = w->getBalance();
+        return WalletOpResult::OK;
+    }
+
+    // Поповнення гаманця
+    void depositToWallet(const string& name, Money amt) {
+        Money balance;
+        switch (deposit(name, amt, &balance)) {
+        case WalletOpResult::NOT_FOUND: cout << "Wallet not found.\n"; break;
+        case WalletOpResult::DECLINED: cout << "Invalid or too large amount.\n"; break;
+        case WalletOpResult::OK: cout << "Deposit successful. Balance: " << balance << "\n"; break;
+        }
+    }
+
+    // Додати витрату
+    void spendFromWallet(const string& name, Money amt, const string& category) {
+        Money balance;
+        switch (spend(name, amt, category, &balance)) {
+        case WalletOpResult::NOT_FOUND: cout << "Wallet not found.\n"; break;
+        case WalletOpResult::DECLINED: cout << "Insufficient funds or credit limit.\n"; break;
+        case WalletOpResult::OK: cout << "Expense added. Balance: " << balance << "\n"; break;
+        }
+        printBudgetAlerts(cout);
+    }
+
+    // Імпорт банківської виписки з CSV: дата, гаманець, категорія, сума.
+    // Від'ємна сума - витрата, додатна - поповнення (категорія поповнень ігнорується).
+    // Роздільник (',' або ';') визначається за першим рядком; перший рядок - заголовок, лише якщо це
+    // назви стовпців date, wallet, category, amount (як пише експорт), інакше він розбирається як дані.
+    // Файл читається шматками, рядки розбираються без копій і додаються пачками по ImportBatchRows;
+    // кожен відхилений рядок описується у errors як "line N: причина".
+    ImportResult importCsv(const string& filename, ostream& errors) {
+        FINANCE_METRIC_TIMER(importCsv);
+        ImportResult result;
+        CsvReader in(filename);
+        if (!in.ok()) { cout << "Failed to open file for reading\n"; return result; }
+        result.opened = true;
+        StatementDateParser dates;
+        vector<ImportRow> batch;
+        batch.reserve(ImportBatchRows);
+        char delim = 0;
+        char* line;
+        size_t len;
+        while (in.nextLine(line, len)) {
+            if (len == 0) continue;
+            bool first = delim == 0;
+            if (first) delim = memchr(line, ';', len) ? ';' : ',';
+            string_view f[4];
+            size_t n = CsvReader::split(line, len, delim, f, 4);
+            if (first && isImportHeader(f, n)) continue;
+            ImportRow row{ {}, in.lineNumber(), {} };
+            auto& r = row.row;
+            if (!dates.parse(f[0], r.date)) {
+                row.error = "invalid date '" + string(f[0]) + "'";
+            }
+            else if (n != 4) {
+                row.error = "expected 4 fields (date, wallet, category, amount), got " + to_string(n);
+            }
+            else if ((r.wallet = ledger->findWallet(f[1])) == StringDictionary::npos) {
+                row.error = "unknown wallet '" + string(f[1]) + "'";
+            }
+            else if (!Money::parse(f[3], r.amount) || r.amount == Money()) {
+                row.error = "invalid amount '" + string(f[3]) + "'";
+            }
+            else if (r.amount < Money()) {
+                r.expense = true;
+                r.amount = -r.amount;
+                r.category = ledger->categoryId(f[2].empty() ? string_view("Other") : f[2]);
+            }
+            else {
+                r.expense = false;
+                r.category = TransactionLedger::DepositCategory;
+            }
+            batch.push_back(move(row));
+            if (batch.size() == ImportBatchRows) {
+                commitImport(batch, errors, result);
+                batch.clear();
+            }
+        }
+        commitImport(batch, errors, result);
+        maybeCompactJournal();
+        return result;
+    }
+
+    // Показати усі транзакції (за певний період або всі)
+    void showAllTransactions(int days = 0) const {
+        time_t start = (days > 0) ? periodStartDays(days) : 0;
+        if (!writeReport(cout, start)) cout << "\nNo transactions found for the selected period.\n";
+    }
+
+    // Збереження звіту у файл
+    void saveReportToFile(const string& filename, int days = 0) const {
+        FINANCE_METRIC_TIMER(reportSave);
+        ofstream fout(filename);
+        if (!fout) {
+            cout << "Failed to open file for writing\n";
+            return;
+        }
+        time_t start = (days > 0) ? periodStartDays(days) : 0;
+        fout << "REPORT (period days: " << days << ")\n";
+        writeReport(fout, start);
+        fout.close();
+        cout << "Report saved to file: " << filename << "\n";
+    }
+
+    // Потоковий експорт рядків, що проходять фільтр (і додатковий предикат extra(row)), у порядку дат.
+    // Рядки читаються курсором пачками з індексу, текст збирається у буфер і скидається у out
+    // кожні ExportFlushBytes - пам'ять не залежить від розміру вибірки. Повертає кількість рядків.
+    // CSV (date,wallet,category,amount; витрати з мінусом) читається назад через importCsv.
+    template <class Pred>
+    size_t exportTransactions(ostream& out, const TransactionFilter& filter, ExportFormat format, Pred&& extra) const {
+        FINANCE_METRIC_TIMER(exportRows);
+        time_t start = (filter.days > 0) ? periodStartDays(filter.days) : 0;
+        const Wallet* wallet = nullptr;
+        if (filter.wallet != StringDictionary::npos) {
+            wallet = walletById(filter.wallet);
+            if (!wallet) return 0;
+        }
+        auto cursor = make_unique<TransactionCursor>(*ledger, wallet, filter, start);
+        ReportBuffer text;
+        if (format == ExportFormat::CSV) text << "date,wallet,category,amount\n";
+        size_t count = 0;
+        RowId r;
+        while (cursor->next(r)) {
+            if (!extra(r)) continue;
+            string_view walletName = ledger->walletName(ledger->walletAt(r));
+            string_view category = ledger->categoryName(ledger->categoryAt(r));
+            bool expense = ledger->isExpenseAt(r);
+            Money amount = ledger->amountAt(r);
+            switch (format) {
+            case ExportFormat::CSV:
+                text.date(ledger->dateAt(r), true) << ',';
+                text.csvField(walletName) << ',';
+                text.csvField(category) << ',';
+                text.money(expense ? -amount : amount) << '\n';
+                break;
+            case ExportFormat::JSONL:
+                text << "{\"date\":\"";
+                text.date(ledger->dateAt(r), true) << "\",\"timestamp\":";
+                text.number(static_cast<long long>(ledger->dateAt(r))) << ",\"wallet\":";
+                text.jsonString(walletName) << ",\"type\":\"" << (expense ? "expense" : "deposit") << "\",\"category\":";
+                text.jsonString(category) << ",\"amount\":";
+                text.money(amount) << "}\n";
+                break;
+            case ExportFormat::TEXT:
+                text << (expense ? "Expense | " : "Deposit | ");
+                formatRow(text, walletName, r);
+                break;
+            }
+            ++count;
+            if (text.size() >= ExportFlushBytes) text.flushTo(out);
+        }
+        text.flushTo(out);
+        return count;
+    }
+
+    size_t exportTransactions(ostream& out, const TransactionFilter& filter, ExportFormat format) const {
+        return exportTransactions(out, filter, format, [](RowId) { return true; });
+    }
+
+    // Експорт у файл; false - файл не відкрився або запис не вдався
+    bool exportTransactionsToFile(const string& filename, const TransactionFilter& filter, ExportFormat format) const {
+        ofstream fout(filename, ios::binary);
+        if (!fout) {
+            cout << "Failed to open file for writing\n";
+            return false;
+        }
+        size_t count = exportTransactions(fout, filter, format);
+        fout.close();
+        if (!fout) {
+            cout << "Failed to write export file\n";
+            return false;
+        }
+        cout << "Exported " << count << " transactions to file: " << filename << "\n";
+        return true;
+    }
+
+    // Збирає усі транзакції (для обробки звітів, топів)
+    vector<Transaction> collectTransactions(int days = 0) const {
+        time_t start = (days > 0) ? periodStartDays(days) : 0;
+        vector<Transaction> all;
+        ledger->forEachRowSince(start, [&](RowId r) { all.push_back(materialize(r)); });
+        return all;
+    }
+
+    // TOP-N рядків за сумою для довільного фільтра.
+    // Обмежена мін-купа розміру topN: O(k log N) часу і O(N) пам'яті на місце хвилі, без копій
+    // транзакцій і без копії вибірки; великі вибірки обробляються паралельно шматками.
+    vector<TransactionView> queryTop(const TransactionFilter& filter, size_t topN) const {
+        vector<TransactionView> result;
+        if (topN == 0) return result;
+        bool plainExpenses = filter.days <= 0 && filter.kind == TransactionKind::EXPENSE
+            && filter.wallet == StringDictionary::npos && filter.category == StringDictionary::npos;
+        if (plainExpenses && topN <= ExpenseAggregates::TopCapacity) {
+            // за весь час відповідь уже є у купі найбільших витрат
+            for (RowId r : ledger->topExpenseRows(topN)) result.emplace_back(*ledger, r);
+            return result;
+        }
+        // кожен шматок хвилі веде власну купу, після хвилі купи зливаються у порядку шматків
+        auto greater = [](const pair<Money, RowId>& a, const pair<Money, RowId>& b) { return a.first > b.first; };
+        vector<vector<pair<Money, RowId>>> heaps;
+        vector<pair<Money, RowId>> heap; // мін-купа: на вершині найменша з найбільших
+        forEachMatchParallel(filter, [&](size_t slots) { heaps.resize(slots); },
+            [&](size_t s, RowId r) { offerTop(heaps[s], topN, ledger->amountAt(r), r); },
+            [&](size_t s) {
+                auto& h = heaps[s];
+                sort_heap(h.begin(), h.end(), greater);
+                for (const auto& e : h) offerTop(heap, topN, e.first, e.second);
+                h.clear();
+            });
+        sort_heap(heap.begin(), heap.end(), greater); // за спаданням суми
+        result.reserve(heap.size());
+        for (const auto& e : heap) result.emplace_back(*ledger, e.second);
+        return result;
+    }
+
+    // TOP-N категорій витрат для довільного фільтра (вид операції завжди "витрата").
+    // Суми рахуються у плоский масив за CategoryId, а відбір - nth_element + сортування лише N елементів.
+    vector<CategoryTotal> queryTopCategories(const TransactionFilter& filter, size_t topN) const {
+        vector<ExpenseAggregates::Bucket> sums;
+        if (filter.wallet == StringDictionary::npos && filter.category == StringDictionary::npos) {
+            // без фільтра за гаманцем/категорією - з інкрементальних агрегатів (O(кількість діб))
+            sums = ledger->categorySumsSince((filter.days > 0) ? periodStartDays(filter.days) : 0);
+        }
+        else if (size_t n; filter.days <= 0 && ledger->liveRowsDense(n)) {
+            // весь час без скасованих рядків: ядра з масками прямо над стовпцями
+            sums = expenseSumsDense(n, filter.wallet, filter.category);
+        }
+        else {
+            // паралельно: окремі суми на шматок хвилі, злиття у порядку шматків
+            TransactionFilter expenses = filter;
+            expenses.kind = TransactionKind::EXPENSE;
+            vector<vector<ExpenseAggregates::Bucket>> partial;
+            forEachMatchParallel(expenses,
+                [&](size_t slots) { partial.resize(slots); },
+                [&](size_t s, RowId r) {
+                    auto& part = partial[s];
+                    CategoryId c = ledger->categoryAt(r);
+                    if (part.size() <= c) part.resize(c + 1); // категорія могла з'явитися під час проходу
+                    part[c].sum += ledger->amountAt(r);
+                    ++part[c].count;
+                },
+                [&](size_t s) {
+                    auto& part = partial[s];
+                    if (sums.size() < part.size()) sums.resize(part.size());
+                    for (CategoryId c = 0; c < part.size(); ++c) {
+                        sums[c].sum += part[c].sum;
+                        sums[c].count += part[c].count;
+                    }
+                    part.assign(part.size(), ExpenseAggregates::Bucket());
+                });
+        }
+        vector<CategoryTotal> vec;
+        for (CategoryId c = 0; c < sums.size(); ++c)
+            if (sums[c].count) vec.push_back({ c, sums[c].sum });
+        auto bySum = [](const CategoryTotal& a, const CategoryTotal& b) { return a.sum > b.sum; };
+        if (vec.size() > topN) {
+            nth_element(vec.begin(), vec.begin() + topN, vec.end(), bySum);
+            vec.resize(topN);
+        }
+        sort(vec.begin(), vec.end(), bySum);
+        return vec;
+    }
+
+    // ТОП витрат (за сумою)
+    vector<TransactionView> topExpenses(int days = 0, int topN = 3) const {
+        FINANCE_METRIC_TIMER(topExpenses);
+        TransactionFilter filter;
+        filter.days = days;
+        filter.kind = TransactionKind::EXPENSE;
+        return queryTop(filter, topN > 0 ? static_cast<size_t>(topN) : 0);
+    }
+
+    // ТОП категорій витрат
+    vector<pair<string, Money>> topCategories(int days = 0, int topN = 3) const {
+        FINANCE_METRIC_TIMER(topCategories);
+        TransactionFilter filter;
+        filter.days = days;
+        vector<pair<string, Money>> vec;
+        for (const auto& c : queryTopCategories(filter, topN > 0 ? static_cast<size_t>(topN) : 0))
+            vec.emplace_back(ledger->categoryName(c.category), c.sum);
+        return vec;
+    }
+
+    // Збереження топ витрат у файл
+    void saveTopExpensesToFile(const string& filename, int days = 0, int topN = 3) const {
+        ofstream fout(filename);
+        if (!fout) { cout << "Failed to open file for writing\n"; return; }
+        ReportBuffer out;
+        out << "TOP-";
+        out.number(topN) << " EXPENSES (last ";
+        out.number(days) << " days)\n";
+        writeTopExpenses(out, topExpenses(days, topN));
+        out.flushTo(fout);
+        fout.close();
+        cout << "Top expenses saved to file: " << filename << "\n";
+    }
+
+    // Збереження топ категорій у файл
+    void saveTopCategoriesToFile(const string& filename, int days = 0, int topN = 3) const {
+        ofstream fout(filename);
+        if (!fout) { cout << "Failed to open file for writing\n"; return; }
+        fout << "TOP-" << topN << " CATEGORIES (last " << days << " days)\n";
+        auto top = topCategories(days, topN);
+        if (top.empty()) fout << "No expenses for the period.\n";
+        for (size_t i = 0; i < top.size(); ++i) {
+            fout << i + 1 << ". Category: " << top[i].first
+                << " | Sum: " << top[i].second << "\n";
+        }
+        fout.close();
+        cout << "Top categories saved to file: " << filename << "\n";
+    }
+
+    // Найдовший календарний ряд (сто років по днях): ряд виділяється під усі точки одразу,
+    // тож більші запити відхиляються при введенні, а тут обрізаються
+    static constexpr int MaxSeriesPeriods = 36600;
+
+    // Календарний ряд витрат за останні periods періодів (поточний - останній) для гаманця/категорії
+    // (не більше MaxSeriesPeriods)
+    vector<SeriesPoint> spendingSeries(SeriesGranularity g, int periods, WalletId wallet = StringDictionary::npos,
+        CategoryId category = StringDictionary::npos) const {
+        if (periods <= 0) return {};
+        periods = min(periods, MaxSeriesPeriods);
+        int64_t last = LocalCalendar().periodOf(nowTime(), g);
+        return ledger->spendingSeries(g, last - periods + 1, last, wallet, category);
+    }
+
+    // Ковзне середнє сум ряду за останні window точок (на початку ряду - за наявні точки)
+    static vector<Money> movingAverage(const vector<SeriesPoint>& points, size_t window) {
+        vector<Money> avg;
+        avg.reserve(points.size());
+        if (window == 0) window = 1;
+        int64_t sum = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            sum += points[i].sum.minorUnits();
+            if (i >= window) sum -= points[i - window].sum.minorUnits();
+            int64_t n = static_cast<int64_t>(min(i + 1, window));
+            avg.push_back(Money::fromMinor((sum >= 0 ? sum + n / 2 : sum - n / 2) / n)); // округлення до копійки
+        }
+        return avg;
+    }
+
+    // Вивід календарного ряду витрат у out; walletName/category порожні - усі
+    void printSpendingSeries(ostream& out, SeriesGranularity g, int periods, const string& walletName = "",
+        const string& category = "", size_t window = 3) const {
+        static const char* names[] = { "Daily", "Weekly", "Monthly" };
+        WalletId w = walletName.empty() ? StringDictionary::npos : ledger->findWallet(walletName);
+        CategoryId c = category.empty() ? StringDictionary::npos : ledger->findCategory(category);
+        ReportBuffer text;
+        text << "\n== " << names[static_cast<int>(g)] << " spending | Wallet: " << (walletName.empty() ? "all" : walletName)
+            << " | Category: " << (category.empty() ? "all" : category) << " ==\n";
+        if ((!walletName.empty() && w == StringDictionary::npos) || (!category.empty() && c == StringDictionary::npos)) {
+            text << "No expenses for the period.\n";
+            text.flushTo(out);
+            return;
+        }
+        auto points = spendingSeries(g, periods, w, c);
+        auto avg = movingAverage(points, window);
+        char label[16];
+        for (size_t i = 0; i < points.size(); ++i) {
+            text << string_view(label, LocalCalendar::label(points[i].period, g, label)) << " | Sum: ";
+            text.money(points[i].sum) << " | Count: ";
+            text.number(points[i].count) << " | Avg(";
+            text.number(static_cast<long long>(window)) << "): ";
+            text.money(avg[i]) << '\n';
+        }
+        text.flushTo(out);
+    }
+
+    // Бюджет на календарний період; walletName/category порожні - усі.
+    // Бюджети зберігаються у знімку і журналі разом з операціями.
+    // false - гаманця чи категорії не знайдено або ліміт не додатний
+    bool setBudget(const string& walletName, const string& category, SeriesGranularity g, Money limit, double warnRatio = 0.8) {
+        Budget b;
+        b.granularity = g;
+        b.limit = limit;
+        b.warnRatio = warnRatio;
+        if (!b.valid()) return false;
+        if (!walletName.empty() && (b.wallet = ledger->findWallet(walletName)) == StringDictionary::npos) return false;
+        if (!category.empty() && (b.category = ledger->findCategory(category)) == StringDictionary::npos) return false;
+        ledger->addBudget(b);
+        return true;
+    }
+
+    // Забирає спрацювання бюджетів після витрат
+    vector<BudgetAlert> takeBudgetAlerts() { return ledger->takeBudgetAlerts(); }
+
+    // Забирає спрацювання бюджетів і дописує їх у text
+    void writeBudgetAlerts(ReportBuffer& text) {
+        auto alerts = takeBudgetAlerts();
+        static const char* names[] = { "day", "week", "month" };
+        char label[16];
+        for (const BudgetAlert& a : alerts) {
+            text << (a.exceeded ? "Budget exceeded: " : "Budget warning: ")
+                << (a.budget.wallet == StringDictionary::npos ? string_view("all wallets") : ledger->walletName(a.budget.wallet)) << " / "
+                << (a.budget.category == StringDictionary::npos ? string_view("all categories") : ledger->categoryName(a.budget.category))
+                << " | " << names[static_cast<int>(a.budget.granularity)] << ' '
+                << string_view(label, LocalCalendar::label(a.period, a.budget.granularity, label)) << " | Spent: ";
+            text.money(a.spent) << " of ";
+            text.money(a.budget.limit) << '\n';
+        }
+    }
+
+    // Виводить і забирає спрацювання бюджетів
+    void printBudgetAlerts(ostream& out) {
+        ReportBuffer text;
+        writeBudgetAlerts(text);
+        if (text.size()) text.flushTo(out);
+    }
+
+    // Збереження метрик (формат Prometheus) у файл
+    bool saveMetricsToFile(const string& filename) const {
+        ofstream fout(filename);
+        if (!fout) { cout << "Failed to open file for writing\n"; return false; }
+        writeMetrics(fout);
+        fout.close();
+        if (!fout) { cout << "Failed to write metrics file\n"; return false; }
+        return true;
+    }
+
+    // Вивід у консоль ТОП витрат
+    void printTopExpensesConsole(int days = 0, int topN = 3) const {
+        ReportBuffer out;
+        out << "\n== TOP-";
+        out.number(topN) << " expenses (last " << (days == 0 ? "all time" : to_string(days) + " days") << ") ==\n";
+        writeTopExpenses(out, topExpenses(days, topN));
+        out.flushTo(cout);
+    }
+
+    // Вивід у консоль ТОП категорій
+    void printTopCategoriesConsole(int days = 0, int topN = 3) const {
+        auto top = topCategories(days, topN);
+        cout << "\n== TOP-" << topN << " categories (last " << (days == 0 ? "all time" : to_string(days) + " days") << ") ==\n";
+        if (top.empty()) { cout << "No expenses for the period.\n"; return; }
+        for (size_t i = 0; i < top.size(); ++i) {
+            cout << i + 1 << ". Category: " << top[i].first
+                << " | Sum: " << top[i].second << "\n";
+        }
+    }
+};
+
+// Пакетний режим: команди з файлу або stdin, по одній на рядок, без підказок.
+// Поля розділяються пробілами; назви з пробілами беруться в лапки ("..." з подвоєними "" всередині);
+// рядки, що починаються з #, пропускаються.
+//   wallet NAME debit | wallet NAME credit LIMIT
+//   deposit WALLET AMOUNT            spend WALLET AMOUNT CATEGORY
+//   report [DAYS]                    top N [DAYS]        topcat N [DAYS]
+//   import FILE                      export csv|jsonl|text FILE [DAYS]
+//   save FILE                        sync
+//   metrics [FILE]                   (метрики у форматі Prometheus; без FILE - у вивід)
+//   series day|week|month N [WALLET|*] [CATEGORY|*] [WINDOW]
+//   budget day|week|month LIMIT [WALLET|*] [CATEGORY|*]
+// Розбір іде в окремому потоці пачками по BatchCommands команд, поки виконується попередня пачка;
+// пачки перевикористовуються, тож рядки команд не виділяють пам'ять у сталому режимі.
+// Успішні операції з гаманцями нічого не виводять, помилки пишуться як "line N: ...",
+// спрацювання бюджетів - одразу після витрати, що їх викликала.
+class BatchRunner {
+public:
+    static constexpr size_t BatchCommands = 8192;
+    static constexpr size_t OutputFlushBytes = 1 << 16;
 
-// Транзакція: описує одну операцію (витрата або поповнення)
-struct Transaction {
-    string category;    // категорія витрати (їжа, транспорт і т.д.)
-    double amount;      // сума
-    time_t date;        // дата операції (time_t - число секунд від 1970 року)
-    bool isExpense;     // true = витрата, false = поповнення
-    string walletName;  // до якого гаманця/картки відноситься
+private:
+    enum class Op { WALLET, DEPOSIT, SPEND, REPORT, TOP, TOPCAT, IMPORT, EXPORT, SAVE, SYNC, METRICS, SERIES, BUDGET, INVALID };
 
-    // Конструктор за замовчуванням (для сумісності з vector)
-    Transaction() = default;
+    struct Command {
+        Op op = Op::INVALID;
+        size_t line = 0;
+        WalletType type = WalletType::DEBIT;
+        ExportFormat format = ExportFormat::CSV;
+        SeriesGranularity granularity = SeriesGranularity::MONTH;
+        Money amount;
+        int number = 0;
+        int days = 0;
+        string name;  // гаманець або файл (для series/budget порожньо - усі гаманці)
+        string arg;   // категорія (для series/budget порожньо - усі); для INVALID - текст помилки
+    };
 
-    // Конструктор з параметрами
-    Transaction(const string& wname, const string& cat, double amt, bool expense)
-        : category(cat), amount(amt), date(time(nullptr)), // записуємо теперішній час
-        isExpense(expense), walletName(wname) {
+    struct Batch {
+        vector<Command> commands = vector<Command>(BatchCommands);
+        size_t count = 0;
+        bool last = false;  // після цієї пачки команд немає
+    };
+
+    FinanceManager& fm;
+    ReportBuffer out;
+    size_t executed = 0, failed = 0;
+
+    // обмін пачками між потоком розбору і виконанням
+    Batch batches[3];
+    deque<Batch*> freeBatches, readyBatches;
+    mutex queueMutex;
+    condition_variable queueChanged;
+
+    // Поля рядка з розкодуванням лапок на місці; повертає кількість полів
+    static size_t tokenize(char* p, size_t len, string_view* fields, size_t maxFields) {
+        char* e = p + len;
+        size_t n = 0;
+        for (;;) {
+            while (p < e && (*p == ' ' || *p == '\t')) ++p;
+            if (p == e) return n;
+            char* start = p;
+            char* stop;
+            if (*p == '"') {
+                char* w = start;
+                for (++p; p < e; ++p) {
+                    if (*p == '"') {
+                        if (p + 1 < e && p[1] == '"') ++p;
+                        else { ++p; break; }
+                    }
+                    *w++ = *p;
+                }
+                stop = w;
+            }
+            else {
+                while (p < e && *p != ' ' && *p != '\t') ++p;
+                stop = p;
+            }
+            if (n < maxFields) fields[n] = string_view(start, static_cast<size_t>(stop - start));
+            ++n;
+        }
+    }
+
+    static bool parseInt(string_view s, int& v) {
+        auto res = from_chars(s.data(), s.data() + s.size(), v);
+        return res.ec == errc() && res.ptr == s.data() + s.size() && v >= 0;
+    }
+
+    static void invalid(Command& c, const char* error) {
+        c.op = Op::INVALID;
+        c.arg = error;
+    }
+
+    // Необов'язкова кількість днів у полі i (0 = весь час)
+    static bool optionalDays(const string_view* f, size_t n, size_t i, Command& c) {
+        c.days = 0;
+        if (n <= i) return true;
+        if (!parseInt(f[i], c.days)) { invalid(c, "invalid number of days"); return false; }
+        return true;
+    }
+
+    // Розбір рядка у команду; false - порожній рядок або коментар
+    static bool parse(char* line, size_t len, size_t lineNo, Command& c) {
+        string_view f[6];
+        size_t n = tokenize(line, len, f, 6);
+        if (n == 0 || (!f[0].empty() && f[0][0] == '#')) return false; // "" - пусте ім'я команди, а не коментар
+        c.line = lineNo;
+        string_view op = f[0];
+        if (op == "wallet") {
+            c.op = Op::WALLET;
+            c.amount = Money();
+            if (n < 3 || n > 4) invalid(c, "usage: wallet NAME debit|credit [LIMIT]");
+            else if (f[2] == "debit" && n == 3) c.type = WalletType::DEBIT;
+            else if (f[2] == "credit") {
+                c.type = WalletType::CREDIT;
+                if (n == 4 && (!Money::parse(f[3], c.amount) || c.amount < Money())) invalid(c, "invalid credit limit");
+            }
+            else invalid(c, "usage: wallet NAME debit|credit [LIMIT]");
+            c.name.assign(f[1]);
+        }
+        else if (op == "deposit" || op == "spend") {
+            bool expense = op == "spend";
+            c.op = expense ? Op::SPEND : Op::DEPOSIT;
+            if (n != (expense ? 4u : 3u)) invalid(c, expense ? "usage: spend WALLET AMOUNT CATEGORY" : "usage: deposit WALLET AMOUNT");
+            else if (!Money::parse(f[2], c.amount) || c.amount <= Money()) invalid(c, "invalid amount");
+            else {
+                c.name.assign(f[1]);
+                if (expense) c.arg.assign(f[3]);
+            }
+        }
+        else if (op == "report") {
+            c.op = Op::REPORT;
+            if (n > 2) invalid(c, "usage: report [DAYS]");
+            else optionalDays(f, n, 1, c);
+        }
+        else if (op == "top" || op == "topcat") {
+            c.op = op == "top" ? Op::TOP : Op::TOPCAT;
+            if (n < 2 || n > 3) invalid(c, "usage: top|topcat N [DAYS]");
+            else if (!parseInt(f[1], c.number)) invalid(c, "invalid N");
+            else optionalDays(f, n, 2, c);
+        }
+        else if (op == "import" || op == "save") {
+            c.op = op == "import" ? Op::IMPORT : Op::SAVE;
+            if (n != 2) invalid(c, op == "import" ? "usage: import FILE" : "usage: save FILE");
+            else c.name.assign(f[1]);
+        }
+        else if (op == "export") {
+            c.op = Op::EXPORT;
+            if (n < 3 || n > 4) invalid(c, "usage: export csv|jsonl|text FILE [DAYS]");
+            else if (f[1] == "csv") c.format = ExportFormat::CSV;
+            else if (f[1] == "jsonl") c.format = ExportFormat::JSONL;
+            else if (f[1] == "text") c.format = ExportFormat::TEXT;
+            else invalid(c, "unknown export format");
+            if (c.op == Op::EXPORT && optionalDays(f, n, 3, c)) c.name.assign(f[2]);
+        }
+        else if (op == "metrics") {
+            c.op = Op::METRICS;
+            c.name.clear();
+            if (n > 2) invalid(c, "usage: metrics [FILE]");
+            else if (n == 2) c.name.assign(f[1]);
+        }
+        else if (op == "series" || op == "budget") {
+            bool series = op == "series";
+            c.op = series ? Op::SERIES : Op::BUDGET;
+            if (n < 3 || n > (series ? 6u : 5u)) {
+                invalid(c, series ? "usage: series day|week|month N [WALLET|*] [CATEGORY|*] [WINDOW]"
+                    : "usage: budget day|week|month LIMIT [WALLET|*] [CATEGORY|*]");
+                return true;
+            }
+            if (f[1] == "day") c.granularity = SeriesGranularity::DAY;
+            else if (f[1] == "week") c.granularity = SeriesGranularity::WEEK;
+            else if (f[1] == "month") c.granularity = SeriesGranularity::MONTH;
+            else { invalid(c, "unknown period (day, week or month)"); return true; }
+            if (series && (!parseInt(f[2], c.number) || c.number == 0 || c.number > FinanceManager::MaxSeriesPeriods)) {
+                invalid(c, "invalid number of periods (1..36600)");
+                return true;
+            }
+            if (!series && (!Money::parse(f[2], c.amount) || c.amount <= Money())) { invalid(c, "invalid budget limit"); return true; }
+            c.name.clear();
+            c.arg.clear();
+            if (n > 3 && f[3] != "*") c.name.assign(f[3]);
+            if (n > 4 && f[4] != "*") c.arg.assign(f[4]);
+            c.days = 3; // вікно ковзного середнього
+            if (n > 5 && (!parseInt(f[5], c.days) || c.days == 0)) invalid(c, "invalid moving average window");
+        }
+        else if (op == "sync") {
+            c.op = Op::SYNC;
+            if (n != 1) invalid(c, "usage: sync");
+        }
+        else invalid(c, "unknown command");
+        return true;
+    }
+
+    // Потік розбору: заповнює вільні пачки і передає їх на виконання
+    void produce(CsvReader& in) {
+        for (bool done = false; !done;) {
+            Batch* b;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&] { return !freeBatches.empty(); });
+                b = freeBatches.front();
+                freeBatches.pop_front();
+            }
+            b->count = 0;
+            char* line;
+            size_t len;
+            while (b->count < BatchCommands) {
+                if (!in.nextLine(line, len)) { done = true; break; }
+                if (parse(line, len, in.lineNumber(), b->commands[b->count])) ++b->count;
+            }
+            b->last = done;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                readyBatches.push_back(b);
+            }
+            queueChanged.notify_all();
+        }
+    }
+
+    void fail(const Command& c, string_view error) {
+        ++failed;
+        out << "line ";
+        out.number(static_cast<long long>(c.line)) << ": " << error << '\n';
+    }
+
+    // Команди, що пишуть у cout самі, виконуються після скидання буфера - порядок виводу зберігається
+    void execute(const Command& c) {
+        ++executed;
+        switch (c.op) {
+        case Op::INVALID:
+            fail(c, c.arg);
+            return;
+        case Op::WALLET:
+            if (!fm.addWallet(c.name, c.type, c.amount)) fail(c, "wallet already exists");
+            return;
+        case Op::DEPOSIT:
+            switch (fm.deposit(c.name, c.amount)) {
+            case WalletOpResult::OK: break;
+            case WalletOpResult::NOT_FOUND: fail(c, "wallet not found"); break;
+            case WalletOpResult::DECLINED: fail(c, "amount too large"); break;
+            }
+            return;
+        case Op::SPEND:
+            switch (fm.spend(c.name, c.amount, c.arg)) {
+            case WalletOpResult::OK: fm.writeBudgetAlerts(out); break;
+            case WalletOpResult::NOT_FOUND: fail(c, "wallet not found"); break;
+            case WalletOpResult::DECLINED: fail(c, "insufficient funds, credit limit or amount too large"); break;
+            }
+            return;
+        case Op::SYNC:
+            if (!fm.syncJournal()) fail(c, "journal write failed");
+            return;
+        default:
+            break;
+        }
+        out.flushTo(cout);
+        switch (c.op) {
+        case Op::REPORT:
+            fm.showAllTransactions(c.days);
+            break;
+        case Op::TOP:
+            fm.printTopExpensesConsole(c.days, c.number);
+            break;
+        case Op::TOPCAT:
+            fm.printTopCategoriesConsole(c.days, c.number);
+            break;
+        case Op::IMPORT: {
+            ImportResult res = fm.importCsv(c.name, cout);
+            if (!res.opened) fail(c, "cannot open import file");
+            else cout << "Imported: " << res.imported << " | Rejected: " << res.rejected << "\n";
+            break;
+        }
+        case Op::EXPORT: {
+            TransactionFilter filter;
+            filter.days = c.days;
+            if (!fm.exportTransactionsToFile(c.name, filter, c.format)) fail(c, "export failed");
+            break;
+        }
+        case Op::SAVE:
+            if (!fm.saveLedgerToFile(c.name)) fail(c, "save failed");
+            break;
+        case Op::SERIES:
+            fm.printSpendingSeries(cout, c.granularity, c.number, c.name, c.arg, static_cast<size_t>(c.days));
+            break;
+        case Op::BUDGET:
+            if (!fm.setBudget(c.name, c.arg, c.granularity, c.amount)) fail(c, "wallet or category not found");
+            break;
+        case Op::METRICS:
+            if (c.name.empty()) writeMetrics(cout);
+            else if (!fm.saveMetricsToFile(c.name)) fail(c, "metrics write failed");
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    explicit BatchRunner(FinanceManager& manager) : fm(manager) {}
+
+    // Виконує всі команди з in; повертає кількість команд з помилкою
+    size_t run(CsvReader& in) {
+        freeBatches.clear();
+        readyBatches.clear();
+        for (Batch& b : batches) freeBatches.push_back(&b);
+        thread parser([&] { produce(in); });
+        for (bool last = false; !last;) {
+            Batch* b;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&] { return !readyBatches.empty(); });
+                b = readyBatches.front();
+                readyBatches.pop_front();
+            }
+            for (size_t i = 0; i < b->count; ++i) {
+                execute(b->commands[i]);
+                if (out.size() >= OutputFlushBytes) out.flushTo(cout);
+            }
+            last = b->last;
+            {
+                lock_guard<mutex> lock(queueMutex);
+                freeBatches.push_back(b);
+            }
+            queueChanged.notify_all();
+        }
+        parser.join();
+        out.flushTo(cout);
+        return failed;
     }
+
+    size_t commandsExecuted() const { return executed; }
 };
 
-// Клас гаманець/картка
-class Wallet {
+// Параметри синтетичного журналу для бенчмарків
+struct SyntheticLedgerConfig {
+    size_t rows = 1000000;       // кількість транзакцій
+    size_t wallets = 8;          // кількість гаманців
+    size_t categories = 40;      // кількість категорій витрат
+    double categorySkew = 1.1;   // показник Zipf для категорій (0 - рівномірно)
+    int days = 365;              // розкид дат: останні N днів до anchor
+    double creditShare = 0.25;   // частка кредитних гаманців
+    double expenseShare = 0.8;   // частка витрат серед транзакцій
+    uint64_t seed = 42;          // той самий seed - той самий журнал
+    time_t anchor = 0;           // дата останньої транзакції (0 - зараз)
+};
+
+// Детермінований генератор великих журналів: власний ГПВЧ (splitmix64) і власний розподіл Zipf,
+// тож при однакових параметрах дані однакові на будь-якій платформі і стандартній бібліотеці.
+// Дати рівномірно зростають до anchor, тому рядки дописуються в кінець індексів.
+class SyntheticLedger {
 private:
-    string name;                  // назва гаманця (наприклад "Cash" або "VISA")
-    WalletType type;              // тип: дебетовий чи кредитний
-    double balance;               // поточний баланс
-    double creditLimit;           // кредитний ліміт (для кредитних карт)
-    vector<Transaction> transactions; // список транзакцій цього гаманця
+    SyntheticLedgerConfig config;
+    uint64_t state;
+    vector<double> categoryCdf;  // накопичені ваги категорій
+    vector<string> categoryNames;
 
 public:
-    // Конструктор
-    Wallet(const string& n, WalletType t, double creditLim = 0.0)
-        : name(n), type(t), balance(0.0), creditLimit(creditLim) {
+    explicit SyntheticLedger(const SyntheticLedgerConfig& c) : config(c), state(c.seed) {
+        if (config.wallets == 0) config.wallets = 1;
+        if (config.categories == 0) config.categories = 1;
+        if (config.days <= 0) config.days = 1;
+        if (config.anchor == 0) config.anchor = time(nullptr);
+        double total = 0;
+        for (size_t k = 0; k < config.categories; ++k) {
+            total += 1.0 / pow(static_cast<double>(k + 1), config.categorySkew);
+            categoryCdf.push_back(total);
+            categoryNames.push_back("Category" + to_string(k));
+        }
     }
 
-    // Гетери (повертають значення полів)
-    const string& getName() const { return name; }
-    WalletType getType() const { return type; }
-    double getBalance() const { return balance; }
-    double getCreditLimit() const { return creditLimit; }
+    const SyntheticLedgerConfig& settings() const { return config; }
 
-    // Доступ до вектора транзакцій (для запису/читання)
-    vector<Transaction>& getTransactions() { return transactions; }
-    const vector<Transaction>& getTransactionsConst() const { return transactions; }
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
 
-    // Поповнення гаманця
-    void deposit(double amt) {
-        if (amt <= 0) return; // захист від від’ємних сум
-        balance += amt;       // збільшуємо баланс
-        // додаємо транзакцію типу "Deposit"
-        transactions.emplace_back(name, "Deposit", amt, false);
+    // Рівномірно у [0, 1)
+    double uniform() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+    // Номер категорії за розподілом Zipf
+    size_t category() {
+        double x = uniform() * categoryCdf.back();
+        size_t k = static_cast<size_t>(upper_bound(categoryCdf.begin(), categoryCdf.end(), x) - categoryCdf.begin());
+        return min(k, categoryCdf.size() - 1);
     }
 
-    // Витрата грошей
-    bool spend(double amt, const string& category) {
-        if (amt <= 0) return false;
+    const string& categoryName(size_t k) const { return categoryNames[k]; }
+    static string walletName(size_t i) { return "Wallet" + to_string(i); }
 
-        if (type == WalletType::DEBIT) { // для дебетових карт
-            if (amt > balance) return false; // якщо недостатньо коштів
-            balance -= amt;                  // знімаємо
-            transactions.emplace_back(name, category, amt, true);
-            return true;
+    // Додає гаманці і транзакції у менеджер (історичні рядки не змінюють балансів;
+    // після генерації кожен гаманець поповнюється, щоб витрати в бенчмарках проходили)
+    void fill(FinanceManager& fm) {
+        vector<Wallet*> wallets;
+        for (size_t i = 0; i < config.wallets; ++i) {
+            // кредитні гаманці розподілені рівномірно серед усіх
+            bool credit = floor(static_cast<double>(i + 1) * config.creditShare) > floor(static_cast<double>(i) * config.creditShare);
+            fm.addWallet(walletName(i), credit ? WalletType::CREDIT : WalletType::DEBIT, credit ? Money::fromUnits(1000000) : Money());
+            wallets.push_back(fm.getWallet(walletName(i)));
         }
-        else { // для кредитних
-            if (balance - amt < -creditLimit) return false; // перевірка ліміту
-            balance -= amt;
-            transactions.emplace_back(name, category, amt, true);
-            return true;
+        const string salary = "Salary";
+        time_t first = config.anchor - static_cast<time_t>(config.days) * 24 * 60 * 60;
+        double step = static_cast<double>(config.anchor - first) / static_cast<double>(max<size_t>(config.rows, 1));
+        for (size_t r = 0; r < config.rows; ++r) {
+            time_t date = first + static_cast<time_t>(static_cast<double>(r) * step);
+            Wallet* w = wallets[below(wallets.size())];
+            if (uniform() < config.expenseShare) {
+                w->addTransaction(categoryNames[category()], Money::fromMinor(100 + static_cast<int64_t>(below(49900))), true, date);
+            }
+            else {
+                w->addTransaction(salary, Money::fromMinor(10000 + static_cast<int64_t>(below(490000))), false, date);
+            }
         }
+        for (Wallet* w : wallets) w->deposit(Money::fromUnits(1000000000));
     }
 };
 
-// Клас для управління всіма гаманцями та звітами
-class FinanceManager {
+// Заміри бенчмарків: затримка на операцію (перцентилі) і пропускна здатність.
+// Дешеві операції міряються групами по opsPerSample, щоб не міряти сам таймер.
+class BenchmarkReport {
 private:
-    vector<Wallet> wallets; // список усіх гаманців
+    string csv = "name,ops,ops_per_sec,items_per_sec,p50_us,p90_us,p99_us,max_us\n";
 
-    // Повертає теперішній час
-    static time_t nowTime() {
-        return time(nullptr);
+public:
+    BenchmarkReport() {
+        char line[160];
+        snprintf(line, sizeof(line), "%-32s %10s %14s %14s %11s %11s %11s %11s\n",
+            "benchmark", "ops", "ops/s", "items/s", "p50 us", "p90 us", "p99 us", "max us");
+        cout << line;
     }
 
-    // Розрахунок початку періоду (N днів назад)
-    static time_t periodStartDays(int days) {
-        if (days <= 0) return 0;
-        time_t now = nowTime();
-        return now - static_cast<time_t>(days) * 24 * 60 * 60;
+    // f() виконує opsPerSample операцій; itemsPerOp - рядків, оброблених однією операцією
+    template <class F>
+    void measure(const string& name, size_t samples, size_t opsPerSample, double itemsPerOp, F&& f) {
+        vector<double> perOp(samples);
+        double total = 0;
+        for (size_t i = 0; i < samples; ++i) {
+            auto t0 = chrono::steady_clock::now();
+            f();
+            double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count());
+            total += ns;
+            perOp[i] = ns / static_cast<double>(opsPerSample);
+        }
+        sort(perOp.begin(), perOp.end());
+        auto pct = [&](double q) { return perOp[min(perOp.size() - 1, static_cast<size_t>(q * static_cast<double>(perOp.size())))] / 1000.0; };
+        size_t ops = samples * opsPerSample;
+        double opsPerSec = total > 0 ? static_cast<double>(ops) * 1e9 / total : 0;
+        char line[256];
+        snprintf(line, sizeof(line), "%-32s %10zu %14.0f %14.0f %11.3f %11.3f %11.3f %11.3f\n",
+            name.c_str(), ops, opsPerSec, opsPerSec * itemsPerOp, pct(0.5), pct(0.9), pct(0.99), perOp.back() / 1000.0);
+        cout << line;
+        cout.flush();
+        snprintf(line, sizeof(line), "%s,%zu,%.0f,%.0f,%.3f,%.3f,%.3f,%.3f\n",
+            name.c_str(), ops, opsPerSec, opsPerSec * itemsPerOp, pct(0.5), pct(0.9), pct(0.99), perOp.back() / 1000.0);
+        csv += line;
     }
 
-    // Форматування часу у вигляді YYYY-MM-DD HH:MM
-    static string formatTime(time_t t) {
-        if (t == 0) return string("-");
-        tm local_tm;
-#if defined(_MSC_VER)   // для MSVC
-        localtime_s(&local_tm, &t);
-#else                  // для Linux/Mingw
-        localtime_r(&t, &local_tm);
-#endif
-        char buf[64];
-        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &local_tm);
-        return string(buf);
+    const string& asCsv() const { return csv; }
+};
+
+// Бенчмарки гарячих шляхів: "--bench [rows=N] [wallets=N] [categories=N] [skew=X] [days=N]
+// [credit=X] [expense=X] [seed=N] [iterations=N] [out=FILE]". Працює лише в пам'яті
+// (без finance.dat і журналу); out - результати у CSV для порівняння між запусками.
+int runBenchmarks(int argc, char** argv) {
+    SyntheticLedgerConfig config;
+    size_t iterations = 10;
+    string outFile;
+    for (int i = 0; i < argc; ++i) {
+        string_view arg(argv[i]);
+        size_t eq = arg.find('=');
+        string_view key = arg.substr(0, eq);
+        string value(eq == string_view::npos ? string_view() : arg.substr(eq + 1));
+        try {
+            if (key == "rows") config.rows = stoull(value);
+            else if (key == "wallets") config.wallets = stoull(value);
+            else if (key == "categories") config.categories = stoull(value);
+            else if (key == "skew") config.categorySkew = stod(value);
+            else if (key == "days") config.days = stoi(value);
+            else if (key == "credit") config.creditShare = stod(value);
+            else if (key == "expense") config.expenseShare = stod(value);
+            else if (key == "seed") config.seed = stoull(value);
+            else if (key == "iterations") iterations = max<size_t>(stoull(value), 1);
+            else if (key == "out") outFile = value;
+            else { cout << "Unknown benchmark option: " << arg << "\n"; return 2; }
+        }
+        catch (const exception&) { cout << "Invalid benchmark option: " << arg << "\n"; return 2; }
+    }
+
+    FinanceManager fm;
+    SyntheticLedger gen(config);
+    auto t0 = chrono::steady_clock::now();
+    gen.fill(fm);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    const auto& c = gen.settings();
+    cout << "Synthetic ledger: " << c.rows << " rows, " << c.wallets << " wallets, " << c.categories
+        << " categories (skew " << c.categorySkew << "), " << c.days << " days, seed " << c.seed
+        << " | generated in " << secs << " s\n\n";
+
+    // сторонні повідомлення методів (наприклад "Report saved") не змішуються з таблицею
+    struct QuietConsole {
+        streambuf* saved = cout.rdbuf(nullptr);
+        ~QuietConsole() { cout.rdbuf(saved); }
+    };
+
+    BenchmarkReport report;
+    vector<string> names;
+    for (size_t i = 0; i < c.wallets; ++i) names.push_back(SyntheticLedger::walletName(i));
+    size_t sink = 0;
+
+    report.measure("getWallet", 20000, 64, 1, [&] {
+        for (int k = 0; k < 64; ++k) sink += fm.getWallet(names[gen.below(names.size())]) != nullptr;
+        });
+    for (int days : { 7, 30, 0 }) {
+        string period = days ? to_string(days) : string("all");
+        double rows = static_cast<double>(fm.collectTransactions(days).size());
+        report.measure("collectTransactions(" + period + ")", iterations, 1, rows, [&] {
+            sink += fm.collectTransactions(days).size();
+            });
+        report.measure("topExpenses(" + period + ",10)", iterations, 1, rows, [&] {
+            sink += fm.topExpenses(days, 10).size();
+            });
+        report.measure("topCategories(" + period + ",5)", iterations, 1, rows, [&] {
+            sink += fm.topCategories(days, 5).size();
+            });
+        const string reportFile = (filesystem::temp_directory_path() / "finance_bench_report.txt").string();
+        report.measure("saveReportToFile(" + period + ")", iterations, 1, rows, [&] {
+            QuietConsole quiet;
+            fm.saveReportToFile(reportFile, days);
+            });
+        remove(reportFile.c_str());
+    }
+    report.measure("spendingSeries(day,365)", iterations * 100, 1, 1, [&] {
+        sink += fm.spendingSeries(SeriesGranularity::DAY, 365).size();
+        });
+    report.measure("spendingSeries(month,36,cat)", iterations * 100, 1, 1, [&] {
+        sink += fm.spendingSeries(SeriesGranularity::MONTH, 36, StringDictionary::npos, fm.getLedger().findCategory(gen.categoryName(0))).size();
+        });
+    // останнім: кожна витрата додає рядок з поточною датою і змінила б вибірки запитів вище
+    report.measure("Wallet::spend", 20000, 16, 1, [&] {
+        for (int k = 0; k < 16; ++k) {
+            Wallet* w = fm.getWallet(names[gen.below(names.size())]);
+            sink += w->spend(Money::fromMinor(100), gen.categoryName(gen.category()));
+        }
+        });
+    if (sink == 0) cout << "\n"; // результати використовуються - компілятор не викине виклики
+
+    if (!outFile.empty()) {
+        ofstream fout(outFile);
+        if (!fout) { cout << "Failed to open file for writing\n"; return 1; }
+        fout << report.asCsv();
+        cout << "\nResults saved to file: " << outFile << "\n";
     }
+    return 0;
+}
+
+// Підсумок самоперевірки: на кожен розділ - рядок "ok"/"FAILED", провалені перевірки друкуються окремо
+class SelfTestReport {
+private:
+    string section;
+    size_t checks = 0, failures = 0, sectionFailures = 0;
 
 public:
-    // Додає новий гаманець
-    bool addWallet(const string& name, WalletType type, double creditLimit = 0.0) {
-        if (getWallet(name) != nullptr) return false; // перевірка на дубль
-        wallets.emplace_back(name, type, creditLimit);
-        return true;
+    void begin(const string& name) { section = name; sectionFailures = 0; }
+
+    void check(bool ok, const string& what) {
+        ++checks;
+        if (ok) return;
+        ++failures;
+        ++sectionFailures;
+        cout << "  FAILED: " << section << ": " << what << "\n";
     }
 
-    // Повертає вказівник на гаманець за іменем
-    Wallet* getWallet(const string& name) {
-        for (auto& w : wallets)
-            if (w.getName() == name) return &w;
-        return nullptr;
+    void end() {
+        char line[160];
+        snprintf(line, sizeof(line), "%-48s %s\n", section.c_str(), sectionFailures ? "FAILED" : "ok");
+        cout << line;
+        cout.flush();
     }
 
-    // Отримати список усіх гаманців (тільки читання)
-    const vector<Wallet>& getAllWallets() const { return wallets; }
+    int summary() const {
+        cout << "\nSelf-test: " << checks << " checks, " << failures << " failed\n";
+        return failures ? 1 : 0;
+    }
+};
 
-    // Поповнення гаманця
-    void depositToWallet(const string& name, double amt) {
-        Wallet* w = getWallet(name);
-        if (!w) { cout << "Wallet not found.\n"; return; }
-        w->deposit(amt);
-        cout << "Deposit successful. Balance: " << fixed << setprecision(2) << w->getBalance() << "\n";
+// Відбиток стану менеджера: гаманці, усі рядки у порядку дат, TOP і ряди (без номера останньої зміни).
+// Однакові відбитки - однаковий стан для всіх запитів, які бачить користувач.
+string ledgerFingerprint(const FinanceManager& fm) {
+    ostringstream out;
+    for (const auto& w : fm.getAllWallets())
+        out << w.getName() << ' ' << (w.getType() == WalletType::CREDIT) << ' ' << w.getBalance() << ' '
+            << w.getCreditLimit() << ' ' << w.getRows().size() << '\n';
+    for (const auto& t : fm.collectTransactions())
+        out << t.walletName << ' ' << t.category << ' ' << t.amount << ' ' << t.isExpense << ' ' << t.date << '\n';
+    for (const auto& c : fm.topCategories(0, 100)) out << c.first << '=' << c.second << ' ';
+    for (const auto& v : fm.topExpenses(0, 10)) out << v.amount() << ' ';
+    for (const auto& p : fm.spendingSeries(SeriesGranularity::DAY, 120)) out << p.sum << '/' << p.count << ' ';
+    return out.str();
+}
+
+// Переписує знімок поточного формату у старий (version 1-4): у версіях 1 і 2 суми і баланси - double,
+// у версії 1 немає номера останньої зміни, до версії 4 немає ознаки зміни балансу, до версії 5 - бюджетів. Розкладка - та, що пишуть writeSnapshotLocked і
+// TransactionLedger::save; так самоперевірка отримує файли старих версій без збережених зразків.
+bool writeLegacySnapshot(const string& from, const string& to, uint32_t version) {
+    MappedFile file;
+    if (!file.open(from)) return false;
+    BinaryReader in(file.data(), file.size());
+    BinaryWriter out(to);
+    auto money = [&] {
+        Money m = in.value<Money>();
+        if (version >= 3) out.value(m);
+        else out.value(m.toDouble());
+    };
+    auto buckets = [&] {
+        uint32_t n = in.value<uint32_t>();
+        out.value(n);
+        for (uint32_t i = 0; i < n && in.ok(); ++i) { money(); out.value(in.value<uint32_t>()); }
+    };
+    auto copyColumn = [&](auto column) { in.column(column); out.column(column); };
+    const char* magic = in.bytes(8);
+    if (!magic) return false;
+    out.bytes(magic, 8);
+    in.value<uint32_t>();
+    out.value(version);
+    out.value(in.value<uint32_t>()); // sizeof(time_t)
+    uint32_t walletCount = in.value<uint32_t>();
+    out.value(walletCount);
+    for (uint32_t i = 0; i < walletCount && in.ok(); ++i) {
+        out.str(in.view());
+        out.value(in.value<uint8_t>());
+        money();
+        money();
+    }
+    uint64_t lastLsn = in.value<uint64_t>();
+    if (version >= 2) out.value(lastLsn);
+    out.value(in.value<uint64_t>()); // скасовані рядки
+    uint32_t categoryCount = in.value<uint32_t>();
+    out.value(categoryCount);
+    for (uint32_t i = 0; i < categoryCount && in.ok(); ++i) out.str(in.view());
+    uint64_t dayCount = in.value<uint64_t>();
+    out.value(dayCount);
+    for (uint64_t i = 0; i < dayCount && in.ok(); ++i) { out.value(in.value<int64_t>()); buckets(); }
+    buckets();
+    uint32_t heapSize = in.value<uint32_t>();
+    out.value(heapSize);
+    for (uint32_t i = 0; i < heapSize && in.ok(); ++i) { money(); out.value(in.value<RowId>()); }
+    Column<Money> amounts;
+    in.column(amounts);
+    if (version >= 3) out.column(amounts);
+    else {
+        Column<double> legacy;
+        for (Money m : amounts) legacy.push_back(m.toDouble());
+        out.column(legacy);
     }
+    copyColumn(Column<time_t>());
+    copyColumn(Column<uint8_t>());
+    copyColumn(Column<WalletId>());
+    copyColumn(Column<CategoryId>());
+    if (version >= 4) copyColumn(Column<uint8_t>());
+    else {
+        Column<uint8_t> balanceFlags;
+        in.column(balanceFlags); // ознаки зміни балансу у старих версіях немає
+    }
+    copyColumn(Column<RowId>());
+    uint32_t budgetCount = in.value<uint32_t>(); // бюджети у старих версіях не зберігались
+    in.bytes(budgetCount * (2 * sizeof(uint32_t) + 1 + sizeof(Money) + sizeof(double)));
+    for (uint32_t i = 0; i < walletCount; ++i) copyColumn(Column<RowId>());
+    return in.ok() && out.close();
+}
 
-    // Додати витрату
-    void spendFromWallet(const string& name, double amt, const string& category) {
-        Wallet* w = getWallet(name);
-        if (!w) { cout << "Wallet not found.\n"; return; }
-        if (w->spend(amt, category)) {
-            cout << "Expense added. Balance: " << fixed << setprecision(2) << w->getBalance() << "\n";
+// Самоперевірка: "--selftest". Розбір сум, відновлення журналу з пошкодженим хвостом, знімки
+// версій 1-5, паралельні витрати під час запитів TOP і звірка запитів з повним перебором.
+// Працює у тимчасовому каталозі; код виходу 0 - усі перевірки пройшли, 1 - є провали.
+int runSelfTests() {
+    SelfTestReport report;
+    const filesystem::path dir = filesystem::temp_directory_path() / "finance_selftest";
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    filesystem::create_directories(dir, ec);
+    const string ledgerFile = (dir / "finance.dat").string();
+    const string journalFile = (dir / "finance.journal").string();
+
+    // повідомлення методів (наприклад "Failed to open file") не змішуються з підсумком
+    struct QuietConsole {
+        streambuf* saved = cout.rdbuf(nullptr);
+        ~QuietConsole() { cout.rdbuf(saved); }
+    };
+
+    report.begin("Money::parse");
+    {
+        struct Case { const char* text; bool ok; int64_t minor; };
+        const Case cases[] = {
+            { "1234.56", true, 123456 }, { "-12,5", true, -1250 }, { "1 234.56", true, 123456 },
+            { "+7", true, 700 }, { " 0.10", true, 10 }, { ".5", true, 50 }, { "5.", true, 500 },
+            { "1.230", true, 123 }, { "-0.05", true, -5 }, { "92233720368547757.99", true, 9223372036854775799 },
+            { "1.231", false, 0 }, { "", false, 0 }, { "-", false, 0 }, { ".", false, 0 },
+            { "1.2.3", false, 0 }, { "1,2.3", false, 0 }, { "1e3", false, 0 }, { "12a", false, 0 },
+            { "--1", false, 0 }, { "92233720368547758", false, 0 }, { "99999999999999999999", false, 0 },
+        };
+        for (const Case& c : cases) {
+            Money m = Money::fromMinor(-1);
+            bool ok = Money::parse(c.text, m);
+            report.check(ok == c.ok && (!ok || m.minorUnits() == c.minor), string("\"") + c.text + "\"");
         }
-        else {
-            cout << "Insufficient funds or credit limit.\n";
+        for (const char* text : { "0.00", "-0.05", "1234567.89", "-92233720368547757.99" }) {
+            Money m;
+            char buf[24];
+            report.check(Money::parse(text, m) && string(buf, m.format(buf)) == text, string("format \"") + text + "\"");
         }
     }
+    report.end();
 
-    // Показати усі транзакції (за певний період або всі)
-    void showAllTransactions(int days = 0) const {
-        time_t start = (days > 0) ? periodStartDays(days) : 0;
-        bool any = false;
-        for (const auto& w : wallets) {
-            cout << "\nWallet: " << w.getName()
-                << " | Type: " << (w.getType() == WalletType::DEBIT ? "DEBIT" : "CREDIT")
-                << " | Balance: " << fixed << setprecision(2) << w.getBalance() << "\n";
-
-            const auto& tr = w.getTransactionsConst();
-            bool empty = true;
-            for (const auto& t : tr) {
-                if (start == 0 || t.date >= start) {
-                    cout << (t.isExpense ? "Expense" : "Deposit")
-                        << " | Wallet: " << t.walletName
-                        << " | Category: " << t.category
-                        << " | Amount: " << fixed << setprecision(2) << t.amount
-                        << " | Date: " << formatTime(t.date) << "\n";
-                    empty = false;
-                    any = true;
-                }
-            }
-            if (empty) cout << "  No transactions for the selected period.\n";
-        }
-        if (!any) cout << "\nNo transactions found for the selected period.\n";
+    report.begin("money overflow");
+    {
+        Money out;
+        const Money max = Money::fromMinor(INT64_MAX), min = Money::fromMinor(INT64_MIN);
+        report.check(!Money::add(max, Money::fromMinor(1), out) && !Money::subtract(min, Money::fromMinor(1), out)
+            && !Money::subtract(Money::fromMinor(-1000), max, out), "checked add/subtract detect overflow");
+        report.check(Money::add(max, Money::fromMinor(-1), out) && out == Money::fromMinor(INT64_MAX - 1), "checked add in range");
+        FinanceManager fm;
+        fm.addWallet("Card", WalletType::CREDIT, Money::fromUnits(1000));
+        fm.addWallet("Cash", WalletType::DEBIT);
+        Money huge;
+        Money::parse("92233720368547757.99", huge);
+        report.check(fm.spend("Card", Money::fromUnits(10), "Food") == WalletOpResult::OK, "spend within the limit");
+        report.check(fm.spend("Card", huge, "Yacht") == WalletOpResult::DECLINED, "huge spend on a credit wallet is declined");
+        report.check(fm.getWallet("Card")->getBalance() == Money::fromUnits(-10), "balance unchanged after the declined spend");
+        const Money room = max - fm.getLedger().recordedVolume(); // найбільша сума, що ще вміщується
+        report.check(fm.deposit("Cash", room) == WalletOpResult::OK, "largest deposit");
+        report.check(fm.deposit("Cash", Money::fromMinor(1)) == WalletOpResult::DECLINED
+            && fm.deposit("Card", huge) == WalletOpResult::DECLINED, "deposits past the ledger volume are declined");
+        report.check(!fm.getWallet("Cash")->addTransaction("Old", huge, true, 1000), "history past the ledger volume is rejected");
+        report.check(fm.getWallet("Cash")->getBalance() == room && fm.topCategories(0, 5).size() == 1
+            && fm.topCategories(0, 5)[0].second == Money::fromUnits(10), "state after rejected operations");
     }
+    report.end();
 
-    // Збереження звіту у файл
-    void saveReportToFile(const string& filename, int days = 0) const {
-        ofstream fout(filename);
-        if (!fout) {
-            cout << "Failed to open file for writing\n";
-            return;
-        }
-        time_t start = (days > 0) ? periodStartDays(days) : 0;
-        fout << "REPORT (period days: " << days << ")\n";
-        for (const auto& w : wallets) {
-            fout << "\nWallet: " << w.getName() << " | Type: "
-                << (w.getType() == WalletType::DEBIT ? "DEBIT" : "CREDIT")
-                << " | Balance: " << fixed << setprecision(2) << w.getBalance() << "\n";
-
-            const auto& tr = w.getTransactionsConst();
-            bool empty = true;
-            for (const auto& t : tr) {
-                if (start == 0 || t.date >= start) {
-                    fout << (t.isExpense ? "Expense" : "Deposit")
-                        << " | Wallet: " << t.walletName
-                        << " | Category: " << t.category
-                        << " | Amount: " << fixed << setprecision(2) << t.amount
-                        << " | Date: " << formatTime(t.date) << "\n";
-                    empty = false;
-                }
+    report.begin("journal replay with a torn tail");
+    {
+        string expected;
+        uint64_t validBytes = 0;
+        {
+            FinanceManager fm;
+            report.check(fm.openJournal(journalFile, ledgerFile), "open journal");
+            fm.addWallet("Cash", WalletType::DEBIT);
+            fm.addWallet("Card", WalletType::CREDIT, Money::fromUnits(100));
+            Wallet* cash = fm.getWallet("Cash");
+            Wallet* card = fm.getWallet("Card");
+            for (int i = 0; i < 600; ++i) {
+                cash->deposit(Money::fromUnits(10));
+                card->spend(Money::fromMinor(5), "Food" + to_string(i % 7));
             }
-            if (empty) fout << "  No transactions for the selected period.\n";
+            cash->addTransaction("Old", Money::fromUnits(3), true, 1000);
+            cash->cancelTransaction(4);
+            report.check(fm.compactJournal(), "compact");
+            for (int i = 0; i < 300; ++i) cash->spend(Money::fromUnits(1), "After");
+            fm.syncJournal();
+            expected = ledgerFingerprint(fm);
         }
-        fout.close();
-        cout << "Report saved to file: " << filename << "\n";
+        validBytes = filesystem::file_size(journalFile, ec);
+        // обірваний заголовок, запис з неправильною сумою і довжина більша за файл
+        const uint32_t badLength = 12, badChecksum = 1, hugeLength = 0xfffffff0;
+        string tails[3];
+        tails[0].assign("\x20\x00\x00", 3);
+        tails[1].append(reinterpret_cast<const char*>(&badLength), 4).append(reinterpret_cast<const char*>(&badChecksum), 4).append(12, 'x');
+        tails[2].append(reinterpret_cast<const char*>(&hugeLength), 4).append(reinterpret_cast<const char*>(&badChecksum), 4);
+        for (const string& tail : tails) {
+            { ofstream f(journalFile, ios::binary | ios::app); f.write(tail.data(), static_cast<streamsize>(tail.size())); }
+            FinanceManager fm;
+            report.check(fm.loadLedgerFromFile(ledgerFile) == LedgerLoadResult::LOADED, "load snapshot");
+            report.check(fm.openJournal(journalFile, ledgerFile), "reopen journal");
+            report.check(ledgerFingerprint(fm) == expected, "state after replay (tail of " + to_string(tail.size()) + " bytes)");
+            report.check(filesystem::file_size(journalFile, ec) == validBytes, "torn tail is cut off");
+        }
+        // журнал без знімка, від якого він іде (гаманці вже у знімку): не застосовується і не змінюється
+        {
+            FinanceManager fm;
+            string reason;
+            report.check(!fm.openJournal(journalFile, ledgerFile + ".other", &reason) && !reason.empty(), "journal without its snapshot");
+            report.check(filesystem::file_size(journalFile, ec) == validBytes, "mismatched journal is left unchanged");
+        }
+        // знімок збережено, а журнал ще не очищено: записи не повторюються
+        {
+            FinanceManager fm;
+            fm.loadLedgerFromFile(ledgerFile);
+            fm.openJournal(journalFile, ledgerFile);
+            QuietConsole quiet;
+            report.check(fm.saveLedgerToFile(ledgerFile), "save snapshot");
+        }
+        {
+            FinanceManager fm;
+            report.check(fm.loadLedgerFromFile(ledgerFile) == LedgerLoadResult::LOADED && fm.openJournal(journalFile, ledgerFile),
+                "reopen after snapshot");
+            report.check(ledgerFingerprint(fm) == expected, "journal is not applied twice");
+        }
+#if !defined(_WIN32)
+        // збій запису (ліміт розміру файлу обриває пачку посередині): пачка не губиться,
+        // обірваний хвіст прибирається, і після відновлення пачка дописується повністю
+        {
+            FinanceManager fm;
+            fm.loadLedgerFromFile(ledgerFile);
+            fm.openJournal(journalFile, ledgerFile);
+            Wallet* cash = fm.getWallet("Cash");
+            rlimit saved;
+            getrlimit(RLIMIT_FSIZE, &saved);
+            rlimit limited = saved;
+            limited.rlim_cur = static_cast<rlim_t>(filesystem::file_size(journalFile, ec) + 100);
+            auto handler = signal(SIGXFSZ, SIG_IGN);
+            setrlimit(RLIMIT_FSIZE, &limited);
+            for (int i = 0; i < 50; ++i) cash->spend(Money::fromUnits(1), "Limited");
+            bool failed = !fm.syncJournal();
+            setrlimit(RLIMIT_FSIZE, &saved);
+            signal(SIGXFSZ, handler);
+            report.check(failed, "write beyond the file size limit fails");
+            report.check(fm.syncJournal(), "kept batch is written after the failure");
+            expected = ledgerFingerprint(fm);
+        }
+        FinanceManager fm;
+        fm.loadLedgerFromFile(ledgerFile);
+        report.check(fm.openJournal(journalFile, ledgerFile) && ledgerFingerprint(fm) == expected, "no operation lost after a failed write");
+#endif
     }
+    report.end();
 
-    // Збирає усі транзакції (для обробки звітів, топів)
-    vector<Transaction> collectTransactions(int days = 0) const {
-        time_t start = (days > 0) ? periodStartDays(days) : 0;
-        vector<Transaction> all;
-        for (const auto& w : wallets) {
-            for (const auto& t : w.getTransactionsConst()) {
-                if (start == 0 || t.date >= start) all.push_back(t);
+    report.begin("snapshot round-trip (versions 1-5)");
+    {
+        string expected;
+        uint64_t lastLsn = 0;
+        filesystem::remove(journalFile, ec);
+        {
+            FinanceManager fm;
+            fm.openJournal(journalFile, ledgerFile); // щоб у знімку був номер останньої зміни
+            fm.addWallet("Cash", WalletType::DEBIT);
+            fm.addWallet("Credit", WalletType::CREDIT, Money::fromMinor(150050));
+            Wallet* cash = fm.getWallet("Cash");
+            Wallet* credit = fm.getWallet("Credit");
+            cash->deposit(Money::fromMinor(100001));
+            const time_t now = time(nullptr), day = 24 * 60 * 60;
+            for (int i = 0; i < 500; ++i) {
+                Wallet* w = i % 3 ? cash : credit;
+                w->addTransaction("Cat" + to_string(i % 9), Money::fromMinor(101 + 37 * i), i % 5 != 0, now - (i % 90) * day - i);
             }
+            credit->spend(Money::fromMinor(12345), "Travel");
+            credit->cancelTransaction(7);
+            report.check(fm.saveLedgerToFile(ledgerFile), "save version 5");
+            expected = ledgerFingerprint(fm);
+            lastLsn = fm.getLedger().getLastLsn();
+            report.check(lastLsn != 0, "snapshot records the last lsn");
         }
-        return all;
-    }
-
-    // ТОП витрат (за сумою)
-    vector<Transaction> topExpenses(int days = 0, int topN = 3) const {
-        auto all = collectTransactions(days);
-        vector<Transaction> expenses;
-        for (const auto& t : all) if (t.isExpense) expenses.push_back(t);
-
-        // сортування за спаданням суми
-        sort(expenses.begin(), expenses.end(), [](const Transaction& a, const Transaction& b) {
-            return a.amount > b.amount;
-            });
-        if ((int)expenses.size() > topN) expenses.resize(topN);
-        return expenses;
+        filesystem::remove(journalFile, ec);
+        for (uint32_t version = 5; version >= 1; --version) {
+            const string path = version == 5 ? ledgerFile : (dir / ("finance.v" + to_string(version))).string();
+            if (version < 5) report.check(writeLegacySnapshot(ledgerFile, path, version), "write version " + to_string(version));
+            FinanceManager fm;
+            report.check(fm.loadLedgerFromFile(path) == LedgerLoadResult::LOADED, "load version " + to_string(version));
+            report.check(ledgerFingerprint(fm) == expected, "state after version " + to_string(version));
+            // версія 1 не зберігає номер останньої зміни
+            report.check(fm.getLedger().getLastLsn() == (version >= 2 ? lastLsn : 0), "lsn after version " + to_string(version));
+        }
+        // пошкоджений файл відхиляється, а поточний стан лишається
+        MappedFile file;
+        file.open(ledgerFile);
+        string bytes(file.data(), file.size());
+        FinanceManager fm;
+        fm.loadLedgerFromFile(ledgerFile);
+        const string corrupt = (dir / "finance.bad").string();
+        for (size_t cut : { size_t(8), size_t(20), bytes.size() / 2, bytes.size() - 1 }) {
+            { ofstream f(corrupt, ios::binary | ios::trunc); f.write(bytes.data(), static_cast<streamsize>(cut)); }
+            report.check(fm.loadLedgerFromFile(corrupt) == LedgerLoadResult::REJECTED, "truncated to " + to_string(cut) + " bytes");
+        }
+        string huge = bytes;
+        const uint32_t walletCount = 0x7fffffff;
+        memcpy(&huge[16], &walletCount, sizeof(walletCount)); // кількість гаманців після magic, версії і sizeof(time_t)
+        { ofstream f(corrupt, ios::binary | ios::trunc); f.write(huge.data(), static_cast<streamsize>(huge.size())); }
+        report.check(fm.loadLedgerFromFile(corrupt) == LedgerLoadResult::REJECTED, "huge wallet count");
+        string newer = bytes;
+        const uint32_t newerVersion = 99;
+        memcpy(&newer[8], &newerVersion, sizeof(newerVersion));
+        { ofstream f(corrupt, ios::binary | ios::trunc); f.write(newer.data(), static_cast<streamsize>(newer.size())); }
+        string reason;
+        report.check(fm.loadLedgerFromFile(corrupt, &reason) == LedgerLoadResult::REJECTED && reason == "unsupported format version 99",
+            "newer format version");
+        report.check(fm.loadLedgerFromFile((dir / "missing.dat").string()) == LedgerLoadResult::MISSING, "missing file");
+        report.check(ledgerFingerprint(fm) == expected, "state kept after rejected files");
     }
+    report.end();
 
-    // ТОП категорій витрат
-    vector<pair<string, double>> topCategories(int days = 0, int topN = 3) const {
-        auto all = collectTransactions(days);
-        map<string, double> sums; // категорія -> загальна сума
-        for (const auto& t : all) if (t.isExpense) sums[t.category] += t.amount;
-
-        vector<pair<string, double>> vec(sums.begin(), sums.end());
-        // сортуємо за сумою
-        sort(vec.begin(), vec.end(), [](const pair<string, double>& a, const pair<string, double>& b) {
-            return a.second > b.second;
-            });
-        if ((int)vec.size() > topN) vec.resize(topN);
-        return vec;
+    report.begin("cancel of historical rows");
+    {
+        filesystem::remove(ledgerFile, ec);
+        filesystem::remove(journalFile, ec);
+        const time_t past = time(nullptr) - 24 * 60 * 60;
+        {
+            FinanceManager fm;
+            report.check(fm.openJournal(journalFile, ledgerFile), "open journal");
+            fm.addWallet("Cash", WalletType::DEBIT);
+            Wallet* cash = fm.getWallet("Cash");
+            cash->deposit(Money::fromUnits(100));                          // рядок 0
+            cash->addTransaction("Food", Money::fromUnits(30), true, past);   // рядок 1
+            cash->addTransaction("Salary", Money::fromUnits(500), false, past); // рядок 2
+            report.check(cash->cancelTransaction(1) && cash->getBalance() == Money::fromUnits(100), "historical expense keeps the balance");
+            report.check(cash->cancelTransaction(2) && cash->getBalance() == Money::fromUnits(100), "historical deposit keeps the balance");
+            cash->addTransaction("Food", Money::fromUnits(20), true, past);   // рядок 3 - у знімку
+            report.check(fm.saveLedgerToFile(ledgerFile), "save snapshot");
+            cash->addTransaction("Rent", Money::fromUnits(40), true, past);   // рядок 4 - лише в журналі
+            report.check(fm.syncJournal(), "sync journal");
+        }
+        FinanceManager fm;
+        report.check(fm.loadLedgerFromFile(ledgerFile) == LedgerLoadResult::LOADED, "load snapshot");
+        report.check(fm.openJournal(journalFile, ledgerFile), "replay journal");
+        Wallet* cash = fm.getWallet("Cash");
+        report.check(cash && cash->cancelTransaction(3) && cash->cancelTransaction(4) && cash->getBalance() == Money::fromUnits(100),
+            "flags survive the snapshot and the journal");
+        report.check(cash && cash->cancelTransaction(0) && cash->getBalance() == Money(), "cancelled deposit reverses the balance");
     }
+    report.end();
 
-    // Збереження топ витрат у файл
-    void saveTopExpensesToFile(const string& filename, int days = 0, int topN = 3) const {
-        ofstream fout(filename);
-        if (!fout) { cout << "Failed to open file for writing\n"; return; }
-        fout << "TOP-" << topN << " EXPENSES (last " << days << " days)\n";
-        auto top = topExpenses(days, topN);
-        if (top.empty()) fout << "No expenses for the period.\n";
-        for (size_t i = 0; i < top.size(); ++i) {
-            fout << i + 1 << ". Wallet: " << top[i].walletName
-                << " | Category: " << top[i].category
-                << " | Amount: " << fixed << setprecision(2) << top[i].amount
-                << " | Date: " << formatTime(top[i].date) << "\n";
+    report.begin("budgets in the snapshot and the journal");
+    {
+        filesystem::remove(ledgerFile, ec);
+        filesystem::remove(journalFile, ec);
+        {
+            FinanceManager fm;
+            report.check(fm.openJournal(journalFile, ledgerFile), "open journal");
+            fm.addWallet("Cash", WalletType::DEBIT);
+            Wallet* cash = fm.getWallet("Cash");
+            cash->deposit(Money::fromUnits(1000));
+            cash->spend(Money::fromUnits(10), "Food");
+            report.check(!fm.setBudget("", "Unknown", SeriesGranularity::MONTH, Money::fromUnits(100))
+                && fm.getLedger().findCategory("Unknown") == StringDictionary::npos, "unknown category is rejected");
+            report.check(fm.setBudget("Cash", "Food", SeriesGranularity::DAY, Money::fromUnits(100)), "set budget");
+            report.check(fm.saveLedgerToFile(ledgerFile), "save snapshot");
+            report.check(fm.setBudget("", "", SeriesGranularity::MONTH, Money::fromUnits(500)), "set budget after the snapshot");
+            report.check(fm.syncJournal(), "sync journal");
         }
-        fout.close();
-        cout << "Top expenses saved to file: " << filename << "\n";
+        FinanceManager fm;
+        report.check(fm.loadLedgerFromFile(ledgerFile) == LedgerLoadResult::LOADED, "load snapshot");
+        report.check(fm.openJournal(journalFile, ledgerFile), "replay journal");
+        Wallet* cash = fm.getWallet("Cash");
+        cash->spend(Money::fromUnits(100), "Food");
+        auto alerts = fm.takeBudgetAlerts();
+        report.check(alerts.size() == 1 && alerts[0].exceeded && alerts[0].budget.granularity == SeriesGranularity::DAY,
+            "budget from the snapshot");
+        cash->spend(Money::fromUnits(300), "Rent");
+        alerts = fm.takeBudgetAlerts();
+        report.check(alerts.size() == 1 && !alerts[0].exceeded && alerts[0].budget.granularity == SeriesGranularity::MONTH,
+            "budget from the journal");
     }
+    report.end();
 
-    // Збереження топ категорій у файл
-    void saveTopCategoriesToFile(const string& filename, int days = 0, int topN = 3) const {
-        ofstream fout(filename);
-        if (!fout) { cout << "Failed to open file for writing\n"; return; }
-        fout << "TOP-" << topN << " CATEGORIES (last " << days << " days)\n";
-        auto top = topCategories(days, topN);
-        if (top.empty()) fout << "No expenses for the period.\n";
-        for (size_t i = 0; i < top.size(); ++i) {
-            fout << i + 1 << ". Category: " << top[i].first
-                << " | Sum: " << fixed << setprecision(2) << top[i].second << "\n";
-        }
-        fout.close();
-        cout << "Top categories saved to file: " << filename << "\n";
+    report.begin("CSV import header");
+    {
+        FinanceManager fm;
+        fm.addWallet("Cash", WalletType::DEBIT);
+        fm.getWallet("Cash")->deposit(Money::fromUnits(100));
+        const string csv = (dir / "import.csv").string();
+        auto import = [&](const char* text, ostringstream& errors) {
+            { ofstream f(csv, ios::binary | ios::trunc); f << text; }
+            return fm.importCsv(csv, errors);
+        };
+        ostringstream errors;
+        ImportResult res = import("Date;Wallet;Category;Amount\n2024-01-05;Cash;Food;-10\n", errors);
+        report.check(res.imported == 1 && res.rejected == 0 && errors.str().empty(), "column names are a header");
+        errors.str("");
+        res = import("2024-13-45,Cash,Food,-10\n2024-01-05,Cash,Food,-10\n", errors);
+        report.check(res.imported == 1 && res.rejected == 1 && errors.str().rfind("line 1: invalid date", 0) == 0,
+            "unparseable first line is a rejected row");
     }
+    report.end();
 
-    // Вивід у консоль ТОП витрат
-    void printTopExpensesConsole(int days = 0, int topN = 3) const {
-        auto top = topExpenses(days, topN);
-        cout << "\n== TOP-" << topN << " expenses (last " << (days == 0 ? "all time" : to_string(days) + " days") << ") ==\n";
-        if (top.empty()) { cout << "No expenses for the period.\n"; return; }
-        for (size_t i = 0; i < top.size(); ++i) {
-            cout << i + 1 << ". Wallet: " << top[i].walletName
-                << " | Category: " << top[i].category
-                << " | Amount: " << fixed << setprecision(2) << top[i].amount
-                << " | Date: " << formatTime(top[i].date) << "\n";
-        }
+    report.begin("concurrent spend with TOP queries");
+    {
+        FinanceManager fm;
+        fm.addWallet("Cash", WalletType::DEBIT);
+        fm.addWallet("Card", WalletType::DEBIT);
+        Wallet* cash = fm.getWallet("Cash");
+        cash->deposit(Money::fromUnits(1000000));
+        cash->spend(Money::fromMinor(1), "One");
+        const CategoryId one = fm.getLedger().findCategory("One");
+        atomic<bool> stop{ false };
+        atomic<size_t> violations{ 0 };
+        // витрати "One" - по 1, "Two" - по 2 мінімальні одиниці: недописаний рядок порушить суми
+        thread queries([&] {
+            Money lastOne, lastTwo;
+            TransactionFilter filter;
+            filter.wallet = cash->getId();
+            TransactionFilter top = filter;
+            top.kind = TransactionKind::EXPENSE;
+            while (!stop.load()) {
+                for (const auto& c : fm.queryTopCategories(filter, 8)) {
+                    Money& last = c.category == one ? lastOne : lastTwo;
+                    bool two = c.category != one;
+                    if (c.sum < last || (two && c.sum.minorUnits() % 2 != 0)) ++violations;
+                    last = c.sum;
+                }
+                for (const auto& v : fm.queryTop(top, 5))
+                    if (v.amount() != Money::fromMinor(1) && v.amount() != Money::fromMinor(2)) ++violations;
+            }
+            });
+        thread cancels([&] {
+            Wallet* card = fm.getWallet("Card");
+            while (!stop.load()) card->cancelTransaction(static_cast<RowId>(fm.getLedger().size() + 1));
+            });
+        for (int i = 0; i < 20000; ++i) cash->spend(Money::fromMinor(i % 2 ? 2 : 1), i % 2 ? "Two" : "One");
+        stop = true;
+        queries.join();
+        cancels.join();
+        report.check(violations.load() == 0, "queries saw partly written rows");
+        TransactionFilter filter;
+        filter.wallet = cash->getId();
+        auto sums = fm.queryTopCategories(filter, 8);
+        report.check(sums.size() == 2 && sums[0].sum == Money::fromMinor(20000) && sums[1].sum == Money::fromMinor(10001),
+            "final category sums");
+        report.check(cash->getBalance() == Money::fromUnits(1000000) - Money::fromMinor(30001), "final balance");
     }
+    report.end();
 
-    // Вивід у консоль ТОП категорій
-    void printTopCategoriesConsole(int days = 0, int topN = 3) const {
-        auto top = topCategories(days, topN);
-        cout << "\n== TOP-" << topN << " categories (last " << (days == 0 ? "all time" : to_string(days) + " days") << ") ==\n";
-        if (top.empty()) { cout << "No expenses for the period.\n"; return; }
-        for (size_t i = 0; i < top.size(); ++i) {
-            cout << i + 1 << ". Category: " << top[i].first
-                << " | Sum: " << fixed << setprecision(2) << top[i].second << "\n";
+    report.begin("TOP and series against brute force");
+    {
+        FinanceManager fm;
+        SyntheticLedgerConfig config;
+        config.rows = 3 * 16384 + 1000; // кілька шматків паралельних проходів
+        config.wallets = 4;
+        config.categories = 12;
+        config.days = 90;
+        config.seed = 7;
+        SyntheticLedger gen(config);
+        gen.fill(fm);
+        const TransactionLedger& ledger = fm.getLedger();
+        const CategoryId category = ledger.findCategory(gen.categoryName(3));
+
+        // рядки, що проходять фільтр, повним перебором індексів гаманців
+        auto matching = [&](const TransactionFilter& f, time_t start) {
+            vector<RowId> rows;
+            for (const auto& w : fm.getAllWallets())
+                for (RowId r : w.getRows())
+                    if (ledger.dateAt(r) >= start && f.matches(ledger, r)) rows.push_back(r);
+            return rows;
+        };
+        // запит і перебір мають бачити ту саму секунду (межа періоду рахується від поточного часу)
+        auto sameSecond = [](auto&& f) {
+            for (int attempt = 0; attempt < 3; ++attempt) {
+                time_t t = time(nullptr);
+                if (f(t) && time(nullptr) == t) return true;
+            }
+            return false;
+        };
+        auto checkQueries = [&](const string& stage) {
+            for (int days : { 0, 30 })
+                for (WalletId wallet : { StringDictionary::npos, WalletId(1) })
+                    for (CategoryId c : { StringDictionary::npos, category })
+                        for (TransactionKind kind : { TransactionKind::ANY, TransactionKind::EXPENSE, TransactionKind::DEPOSIT }) {
+                            TransactionFilter f;
+                            f.days = days; f.wallet = wallet; f.category = c; f.kind = kind;
+                            string name = stage + " days=" + to_string(days) + " wallet=" + to_string(wallet != StringDictionary::npos)
+                                + " category=" + to_string(c != StringDictionary::npos) + " kind=" + to_string(static_cast<int>(kind));
+                            bool ok = sameSecond([&](time_t now) {
+                                time_t start = days > 0 ? now - static_cast<time_t>(days) * 24 * 60 * 60 : 0;
+                                vector<Money> expected;
+                                for (RowId r : matching(f, start)) expected.push_back(ledger.amountAt(r));
+                                sort(expected.begin(), expected.end(), [](Money a, Money b) { return a > b; });
+                                if (expected.size() > 10) expected.resize(10);
+                                vector<Money> actual;
+                                for (const auto& v : fm.queryTop(f, 10)) actual.push_back(v.amount());
+                                if (actual != expected) return false;
+                                if (kind != TransactionKind::ANY) return true;
+                                map<CategoryId, Money> sums;
+                                TransactionFilter expenses = f;
+                                expenses.kind = TransactionKind::EXPENSE;
+                                for (RowId r : matching(expenses, start)) sums[ledger.categoryAt(r)] += ledger.amountAt(r);
+                                map<CategoryId, Money> got;
+                                for (const auto& t : fm.queryTopCategories(f, 100)) got[t.category] = t.sum;
+                                return got == sums;
+                                });
+                            report.check(ok, "TOP " + name);
+                        }
+            for (SeriesGranularity g : { SeriesGranularity::DAY, SeriesGranularity::WEEK, SeriesGranularity::MONTH })
+                for (WalletId wallet : { StringDictionary::npos, WalletId(2) }) {
+                    bool ok = sameSecond([&](time_t now) {
+                        LocalCalendar calendar;
+                        const int periods = 20;
+                        int64_t last = calendar.periodOf(now, g);
+                        map<int64_t, pair<Money, uint32_t>> expected;
+                        TransactionFilter f;
+                        f.wallet = wallet;
+                        f.kind = TransactionKind::EXPENSE;
+                        for (RowId r : matching(f, 0)) {
+                            int64_t p = calendar.periodOf(ledger.dateAt(r), g);
+                            if (p > last - periods && p <= last) { expected[p].first += ledger.amountAt(r); ++expected[p].second; }
+                        }
+                        auto series = fm.spendingSeries(g, periods, wallet);
+                        if (series.size() != static_cast<size_t>(periods)) return false;
+                        for (const auto& p : series) {
+                            auto it = expected.find(p.period);
+                            Money sum = it == expected.end() ? Money() : it->second.first;
+                            uint32_t count = it == expected.end() ? 0 : it->second.second;
+                            if (p.sum != sum || p.count != count) return false;
+                        }
+                        return true;
+                        });
+                    report.check(ok, stage + " series granularity=" + to_string(static_cast<int>(g))
+                        + " wallet=" + to_string(wallet != StringDictionary::npos));
+                }
+        };
+        checkQueries("dense");
+        // скасовані рядки вимикають прохід прямо по стовпцях - звіряємо і загальний шлях
+        for (size_t i = 0; i < fm.getAllWallets().size(); ++i) {
+            Wallet* w = fm.getWallet(SyntheticLedger::walletName(i));
+            const auto& rows = w->getRows();
+            for (size_t k = 0; k < 5 && rows.size() > 100; ++k) w->cancelTransaction(rows[rows.size() / 2 - k * 10]);
         }
+        checkQueries("with cancelled rows");
     }
-};
+    report.end();
+
+    filesystem::remove_all(dir, ec);
+    return report.summary();
+}
 
 // Функція для вибору періоду (день/тиждень/місяць/весь час)
 int choosePeriodDays() {
@@ -325,49 +4802,81 @@ int choosePeriodDays() {
 
 // Додає тестові транзакції (для демонстрації)
 void addDemoTransactions(FinanceManager& fm) {
+    const time_t day = 24 * 60 * 60;
     Wallet* w = fm.getWallet("Cash");
     if (w) {
-        w->deposit(500);
-        Transaction t1("Cash", "Food", 120, true); t1.date = time(nullptr) - 24 * 60 * 60;
-        w->getTransactions().push_back(t1);
-        Transaction t2("Cash", "Taxi", 50, true); t2.date = time(nullptr) - 8 * 24 * 60 * 60;
-        w->getTransactions().push_back(t2);
-        Transaction t3("Cash", "Coffee", 15, true); t3.date = time(nullptr) - 30 * 24 * 60 * 60;
-        w->getTransactions().push_back(t3);
+        w->deposit(Money::fromUnits(500));
+        w->addTransaction("Food", Money::fromUnits(120), true, time(nullptr) - day);
+        w->addTransaction("Taxi", Money::fromUnits(50), true, time(nullptr) - 8 * day);
+        w->addTransaction("Coffee", Money::fromUnits(15), true, time(nullptr) - 30 * day);
     }
     Wallet* v = fm.getWallet("VISA_Card");
     if (v) {
-        v->deposit(1000);
-        Transaction t1("VISA_Card", "Groceries", 250, true); t1.date = time(nullptr) - 3 * 24 * 60 * 60;
-        v->getTransactions().push_back(t1);
-        Transaction t2("VISA_Card", "Sport", 100, true); t2.date = time(nullptr) - 16 * 24 * 60 * 60;
-        v->getTransactions().push_back(t2);
+        v->deposit(Money::fromUnits(1000));
+        v->addTransaction("Groceries", Money::fromUnits(250), true, time(nullptr) - 3 * day);
+        v->addTransaction("Sport", Money::fromUnits(100), true, time(nullptr) - 16 * day);
     }
     Wallet* c = fm.getWallet("Credit_MC");
     if (c) {
-        c->deposit(700);
-        Transaction t1("Credit_MC", "Electronics", 400, true); t1.date = time(nullptr) - 5 * 24 * 60 * 60;
-        c->getTransactions().push_back(t1);
-        Transaction t2("Credit_MC", "Travel", 300, true); t2.date = time(nullptr) - 31 * 24 * 60 * 60;
-        c->getTransactions().push_back(t2);
+        c->deposit(Money::fromUnits(700));
+        c->addTransaction("Electronics", Money::fromUnits(400), true, time(nullptr) - 5 * day);
+        c->addTransaction("Travel", Money::fromUnits(300), true, time(nullptr) - 31 * day);
     }
 }
 
-// Головна функція програми
-int main() {
+// Пакетний режим: виконує команди з файлу (або stdin, якщо path == "-") і зберігає стан.
+// Код виходу: 0 - усі команди виконані, 1 - були помилки, 2 - не вдалося відкрити файл команд.
+int runBatch(FinanceManager& fm, const string& path, const string& ledgerFile) {
+    unique_ptr<CsvReader> in = path == "-" ? make_unique<CsvReader>(stdin) : make_unique<CsvReader>(path);
+    if (!in->ok()) { cout << "Failed to open command file: " << path << "\n"; return 2; }
+    BatchRunner runner(fm);
+    size_t failed = runner.run(*in);
+    if (!fm.syncJournal()) { cout << "Failed to write journal\n"; failed = max<size_t>(failed, 1); }
+    if (!fm.compactJournal() && !fm.saveLedgerToFile(ledgerFile)) failed = max<size_t>(failed, 1);
+    cout << "Batch: " << runner.commandsExecuted() << " commands, " << failed << " failed\n";
+    cout.flush();
+    return failed ? 1 : 0;
+}
+
+// Головна функція програми.
+// Без аргументів - інтерактивне меню; "--batch [FILE]" - пакетний режим (без FILE або "-" - stdin);
+// "--bench [параметри]" - бенчмарки на синтетичному журналі; "--selftest" - самоперевірка.
+int main(int argc, char** argv) {
     ios::sync_with_stdio(false); // вимикаємо синхронізацію з stdio для швидшої роботи
     cin.tie(nullptr); // відв’язуємо cin від cout, щоб не було автоматичного flush
+    if (argc > 1 && string_view(argv[1]) == "--bench") return runBenchmarks(argc - 2, argv + 2);
+    if (argc > 1 && string_view(argv[1]) == "--selftest") return runSelfTests();
 
     FinanceManager fm; // створюємо менеджер фінансів
-    cout << "=== Personal Finance Management System ===\n"; // виводимо заголовок
+    bool batch = argc > 1 && string_view(argv[1]) == "--batch";
+    if (!batch) cout << "=== Personal Finance Management System ===\n"; // виводимо заголовок
 
-    // додаємо приклади гаманців і карт
-    fm.addWallet("Cash", WalletType::DEBIT); // гаманець (готівка)
-    fm.addWallet("VISA_Card", WalletType::DEBIT); // дебетова картка
-    fm.addWallet("Credit_MC", WalletType::CREDIT, 1000.0); // кредитна картка з лімітом 1000
+    const string ledgerFile = "finance.dat";      // бінарний файл зі збереженим станом
+    const string journalFile = "finance.journal"; // журнал змін після останнього знімка
+    // файли, які не вдалося прочитати, не перезаписуються: без них програма не запускається
+    string reason;
+    LedgerLoadResult loaded = fm.loadLedgerFromFile(ledgerFile, &reason);
+    if (loaded == LedgerLoadResult::REJECTED) {
+        cout << "Failed to load ledger file " << ledgerFile << ": " << reason << "\n"
+            << "Move or restore the file and start again; it was left unchanged.\n";
+        return 1;
+    }
+    if (loaded == LedgerLoadResult::LOADED && !batch) cout << "Ledger loaded from file: " << ledgerFile << "\n";
+    if (!fm.openJournal(journalFile, ledgerFile, &reason)) {
+        cout << "Failed to open journal " << journalFile << ": " << reason << "\n"
+            << "Move or restore the journal and start again; " << ledgerFile << " was left unchanged.\n";
+        return 1;
+    }
+    if (batch) return runBatch(fm, argc > 2 ? argv[2] : "-", ledgerFile);
+    if (fm.getAllWallets().empty()) {
+        // додаємо приклади гаманців і карт
+        fm.addWallet("Cash", WalletType::DEBIT); // гаманець (готівка)
+        fm.addWallet("VISA_Card", WalletType::DEBIT); // дебетова картка
+        fm.addWallet("Credit_MC", WalletType::CREDIT, Money::fromUnits(1000)); // кредитна картка з лімітом 1000
 
-    // додаємо тестові транзакції для демонстрації
-    addDemoTransactions(fm);
+        // додаємо тестові транзакції для демонстрації
+        addDemoTransactions(fm);
+    }
 
     while (true) { // головний цикл програми
         cout << "\n--- MENU ---\n"; // меню
@@ -380,6 +4889,11 @@ int main() {
         cout << "7. Save report to file\n";
         cout << "8. Save TOP-3 expenses to file (week/month)\n";
         cout << "9. Save TOP-3 categories to file (week/month)\n";
+        cout << "10. Import transactions from CSV\n";
+        cout << "11. Export transactions (CSV/JSON Lines/text)\n";
+        cout << "12. Save metrics to file\n";
+        cout << "13. Spending by day/week/month\n";
+        cout << "14. Set budget\n";
         cout << "0. Exit\n";
         cout << "Choice: ";
 
@@ -405,19 +4919,19 @@ int main() {
                 else cout << "Wallet with this name already exists\n";
             }
             else { // кредитний
-                double lim; cout << "Enter credit limit (e.g. 1000): "; cin >> lim; cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                Money lim; cout << "Enter credit limit (e.g. 1000): "; cin >> lim; cin.ignore(numeric_limits<streamsize>::max(), '\n');
                 if (fm.addWallet(name, WalletType::CREDIT, lim)) cout << "CREDIT card added\n";
                 else cout << "Wallet with this name already exists\n";
             }
         }
         else if (choice == 2) { // поповнення
-            string name; double amt;
+            string name; Money amt;
             cout << "Wallet/card name to deposit into: "; getline(cin, name);
             cout << "Deposit amount: "; cin >> amt; cin.ignore(numeric_limits<streamsize>::max(), '\n');
             fm.depositToWallet(name, amt); // поповнюємо
         }
         else if (choice == 3) { // витрата
-            string name, cat; double amt;
+            string name, cat; Money amt;
             cout << "Wallet/card name for expense: "; getline(cin, name);
             cout << "Expense amount: "; cin >> amt; cin.ignore(numeric_limits<streamsize>::max(), '\n');
             cout << "Expense category (e.g. Groceries, Transport): "; getline(cin, cat);
@@ -464,11 +4978,73 @@ int main() {
             getline(cin, filename);
             fm.saveTopCategoriesToFile(filename, days, 3);
         }
+        else if (choice == 10) { // імпорт банківської виписки
+            string filename;
+            cout << "CSV file (date, wallet, category, amount; negative amount = expense): ";
+            getline(cin, filename);
+            const string errorsFile = "import_errors.txt";
+            ofstream errors(errorsFile);
+            ImportResult res = fm.importCsv(filename, errors);
+            errors.close();
+            if (res.opened) cout << "Imported: " << res.imported << " | Rejected: " << res.rejected << "\n";
+            if (res.rejected) cout << "Rejected rows are listed in file: " << errorsFile << "\n";
+            else remove(errorsFile.c_str());
+        }
+        else if (choice == 11) { // експорт транзакцій
+            TransactionFilter filter;
+            filter.days = choosePeriodDays();
+            cout << "Format: 1) CSV  2) JSON Lines  3) Text\nYour choice: ";
+            int ch; cin >> ch; cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            ExportFormat format = (ch == 2 ? ExportFormat::JSONL : (ch == 3 ? ExportFormat::TEXT : ExportFormat::CSV));
+            string walletName, category, filename;
+            cout << "Wallet/card name (empty = all): "; getline(cin, walletName);
+            cout << "Category (empty = all): "; getline(cin, category);
+            cout << "Filename for export (e.g. export.csv): "; getline(cin, filename);
+            if (!walletName.empty()) filter.wallet = fm.getLedger().findWallet(walletName);
+            if (!category.empty()) filter.category = fm.getLedger().findCategory(category);
+            if ((!walletName.empty() && filter.wallet == StringDictionary::npos)
+                || (!category.empty() && filter.category == StringDictionary::npos)) {
+                cout << "Wallet or category not found\n";
+            }
+            else fm.exportTransactionsToFile(filename, filter, format);
+        }
+        else if (choice == 12) { // метрики
+            string filename;
+            cout << "Filename for metrics (e.g. metrics.prom): ";
+            getline(cin, filename);
+            if (fm.saveMetricsToFile(filename)) cout << "Metrics saved to file: " << filename << "\n";
+        }
+        else if (choice == 13 || choice == 14) { // календарні ряди / бюджет
+            cout << "1) Day  2) Week  3) Month\nYour choice: ";
+            int ch; cin >> ch; cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            SeriesGranularity g = (ch == 1 ? SeriesGranularity::DAY : (ch == 2 ? SeriesGranularity::WEEK : SeriesGranularity::MONTH));
+            string walletName, category;
+            cout << "Wallet/card name (empty = all): "; getline(cin, walletName);
+            cout << "Category (empty = all): "; getline(cin, category);
+            if (choice == 13) {
+                cout << "How many periods: ";
+                int periods = 0; cin >> periods;
+                if (cin.fail()) cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                if (periods <= 0 || periods > FinanceManager::MaxSeriesPeriods)
+                    cout << "Invalid number of periods (1.." << FinanceManager::MaxSeriesPeriods << ")\n";
+                else fm.printSpendingSeries(cout, g, periods, walletName, category);
+            }
+            else {
+                Money limit; cout << "Budget limit: "; cin >> limit; cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                if (fm.setBudget(walletName, category, g, limit)) cout << "Budget set\n";
+                else cout << "Wallet or category not found, or invalid limit\n";
+            }
+        }
         else {
             cout << "Unknown command\n"; // якщо ввели неправильний пункт
         }
+        if (!fm.syncJournal()) // інтерактивні зміни одразу скидаємо на диск
+            cout << "Failed to write journal: recent changes are kept in memory and saved on exit\n";
     }
 
+    // зберігаємо стан: знімок + порожній журнал (якщо ущільнення не вдалося - хоча б знімок)
+    if (fm.compactJournal() || fm.saveLedgerToFile(ledgerFile)) cout << "Ledger saved to file: " << ledgerFile << "\n";
     cout << "Thank you! Goodbye.\n"; // повідомлення при виході
     return 0; // завершення програми
 }